@@ -7,14 +7,15 @@ inherit CommandController;
 
 inherit ValidationLib;
 
-int load_files(mapping model, string verb);
+mapping load_files(mapping model, string verb);
 
-int execute(mapping model, string verb) {
+mapping execute(mapping model, string verb) {
   return load_files(model, verb);
 }
 
-int load_files(mapping model, string verb) {
+mapping load_files(mapping model, string verb) {
   int count = 0;
+  mixed *loaded = ({ });
   foreach (mixed *f : model["files"]) {
     string file = f[0];
     if (FINDO(file)) {
@@ -36,6 +37,7 @@ int load_files(mapping model, string verb) {
       continue;
     } else {
       count++;
+      loaded += ({ f });
       if (model["verbose"]) {
         stdout_msg(sprintf("%s: %s: loaded\n", verb, file));
       }
@@ -46,5 +48,9 @@ int load_files(mapping model, string verb) {
     stdout_msg(sprintf("%s: %d object%s loaded.\n", 
                        verb, count, (count != 1 ? "s" : "")));
   }
-  return count;
+  if (!sizeof(loaded)) {
+    return 0;
+  }
+  // loaded files may be piped to the next command
+  return ([ "files" : loaded ]);
 }
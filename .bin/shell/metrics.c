@@ -0,0 +1,61 @@
+/**
+ * Controller for reporting command execution metrics.
+ *
+ * @alias MetricsController
+ */
+#include <metrics.h>
+
+inherit CommandController;
+
+private inherit FileLib;
+
+string format_metrics(mapping metrics, string category);
+
+mapping execute(mapping model, string verb) {
+  string category = model["category"];
+  if (!category || !strlen(category)) {
+    category = METRIC_VERB;
+  }
+  if ((category != METRIC_VERB) && (category != METRIC_CONTROLLER)) {
+    stderr_msg(sprintf("%s: %s: Unknown category, expected %s or %s.\n",
+                       verb, category, METRIC_VERB, METRIC_CONTROLLER));
+    return 0;
+  }
+
+  string out = format_metrics(MetricsService->query_metrics(category),
+                              category);
+  string file = model["file"];
+  if (file && strlen(file)) {
+    file = expand_path(file, THISP);
+    if (!write_file(file, out, 1)) {
+      stderr_msg(sprintf("%s: %s: Unable to write file.\n", verb, file));
+      return 0;
+    }
+    stdout_msg(sprintf("%s: %s metrics written to %s\n",
+                       verb, category, file));
+  } else {
+    stdout_msg(out);
+  }
+  return ([ ]);
+}
+
+string format_metrics(mapping metrics, string category) {
+  // most expensive first
+  string *names = sort_array(m_indices(metrics), (:
+    ($3[$1][SUMMARY_COUNT] * $3[$1][SUMMARY_TICKS_AVG])
+      < ($3[$2][SUMMARY_COUNT] * $3[$2][SUMMARY_TICKS_AVG])
+  :), metrics);
+  string out = sprintf("%-24s %7s | %9s %9s %9s %9s | %9s %9s %9s %9s\n",
+                       category, "count", "ticks p50", "p95", "p99", "max",
+                       "usec p50", "p95", "p99", "max");
+  foreach (string name : names) {
+    mixed *m = metrics[name];
+    out += sprintf("%-24s %7d | %9d %9d %9d %9d | %9d %9d %9d %9d\n",
+                   name, m[SUMMARY_COUNT], m[SUMMARY_TICKS_P50],
+                   m[SUMMARY_TICKS_P95], m[SUMMARY_TICKS_P99],
+                   m[SUMMARY_TICKS_MAX], m[SUMMARY_USEC_P50],
+                   m[SUMMARY_USEC_P95], m[SUMMARY_USEC_P99],
+                   m[SUMMARY_USEC_MAX]);
+  }
+  return out;
+}
@@ -4,4 +4,16 @@
 #define DEFAULT_OPEN      "\"([{"
 #define DEFAULT_CLOSE     "\")]}"
 
+#define TOKEN_KIND        0
+#define TOKEN_TEXT        1
+#define TOKEN_VALUE       2
+#define TOKEN_START       3
+#define TOKEN_END         4
+
+#define TOKEN_WORD        0
+#define TOKEN_QUOTED      1
+#define TOKEN_OPT         2
+#define TOKEN_LONGOPT     3
+#define TOKEN_END_OPTS    4
+
 #endif  // _ARGUMENT_H
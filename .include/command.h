@@ -8,6 +8,11 @@
 #define COMMAND_SYNTAX        4
 #define COMMAND_VALIDATION    5
 #define COMMAND_MAX_RETRY     6
+#define COMMAND_SPECFILE      7
+#define COMMAND_POSITION      8
+#define COMMAND_PARSER        9
+#define COMMAND_BUDGET        10
+#define COMMAND_CACHEABLE     11
 
 #define FIELD_ID              0
 #define FIELD_TYPE            1
@@ -52,6 +57,30 @@
 #define SYNTAX_LONGOPTS       7
 #define SYNTAX_VALIDATION     8
 #define SYNTAX_SUBCOMMANDS    9
+#define SYNTAX_VALID_OPTS     10
+#define SYNTAX_VALID_LONGOPTS 11
+#define SYNTAX_MIN_NUMARGS    12
+#define SYNTAX_MAX_NUMARGS    13
+#define SYNTAX_STRATEGY       14
+#define SYNTAX_OPT_SIGNATURE  15
+#define SYNTAX_PARSER         16
+
+#define STRATEGY_EXPLODE      0
+#define STRATEGY_SSCANF       1
+#define STRATEGY_REGEXP       2
+#define STRATEGY_PARSE_COMMAND 3
+
+#define GENERATED_SYNTAX      0
+#define GENERATED_OPTS        1
+#define GENERATED_BADOPTS     2
+#define GENERATED_ARGS        3
+
+// eval and memory budgets for execute(), 0 leaves the budget unset
+#define BUDGET_EVAL           0
+#define BUDGET_ARRAY          1
+#define BUDGET_MAPPING        2
+#define BUDGET_BYTE           3
+#define BUDGET_SIZE           4
 
 #define TRUE_VALUE            "true"
 #define FALSE_VALUE           "false"
@@ -61,6 +90,7 @@
 #define PROMPT_NEVER          "never"
 
 #define MAX_ARGS              26
+#define UNMATCHED_ARG         "__UNMATCHED_PARSE_COMMAND_ARG"
 #define VALIDATION_PREFIX     "validate_"
 #define VALIDATE_SKIP_FIELDS  0x01
 #define VALIDATION_PASS       1
@@ -4,5 +4,30 @@
 #define DEFAULT_CMD_PROMPT  "(%t) %m%d{ [%s]}: "
 #define DEFAULT_CMD_FAIL    "%m\n"
 
+// command processing stages, see process_command()
+#define STAGE_ARGS          0
+#define STAGE_OPTS          1
+#define STAGE_LONGOPTS      2
+#define STAGE_EXTRA         3
+#define STAGE_VALIDATE      4
+#define STAGE_EXECUTE       5
+
+// result cache for cacheable commands, see execute_command()
+#define CACHE_MAX_ENTRIES   256
+// every write, checked against the cached paths by cache_signal()
+#define CACHE_WATCH_REGEX   "."
+#define CACHE_RESULT        0
+#define CACHE_MESSAGES      1
+#define CACHE_PATHS         2
+
+#define CAPTURED_STDERR     0
+#define CAPTURED_MESSAGE    1
+#define CAPTURED_CONTEXT    2
+#define CAPTURED_TOPIC      3
+
+// errors raised by limited() when the eval or a memory budget is exceeded
+#define BUDGET_EVAL_REGEX   "Too long evaluation"
+#define BUDGET_ERROR_REGEX  "Illegal (array|mapping|string) size|Out of memory"
+
 #endif  // _COMMAND_CONTROLLER_H
 
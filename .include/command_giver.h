@@ -10,4 +10,21 @@
 #define GRANT_ACCESS_UNFORCED      1
 #define GRANT_ACCESS_ALL           2
 
+#define VERB_ORDER                 0
+#define VERB_VERB                  1
+#define VERB_SPECFILE              2
+#define VERB_COMMAND               3
+#define VERB_CONTROLLER            4
+
+#define SCRIPT_SLICE_TICKS         100000
+#define SCRIPT_EVAL_RESERVE        50000
+#define SCRIPT_LINE_NUMBER         0
+#define SCRIPT_LINE_TEXT           1
+
+#define SCRIPT_INFO_FILE           0
+#define SCRIPT_INFO_LINE           1
+#define SCRIPT_INFO_LINES          2
+#define SCRIPT_INFO_PAUSED         3
+#define SCRIPT_INFO_ERRORS         4
+
 #endif  // _COMMAND_GIVER_H
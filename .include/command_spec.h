@@ -3,6 +3,25 @@
 
 #include <command.h>
 
+#define COMMAND_SPEC_REGEX  "\\.cmds$"
+#define CONTROLLER_REGEX    "\\.c$"
+
+// compiled spec cache, bump the version when the compiled layout changes
+#define COMPILED_SPEC_SUFFIX  ".val"
+#define COMPILED_SPEC_VERSION 6
+
+#define COMPILED_VERSION    0
+#define COMPILED_MTIME      1
+#define COMPILED_HASH       2
+#define COMPILED_COMMANDS   3
+#define COMPILED_IMPORTS    4
+#define COMPILED_SIZE       5
+
+#define IMPORT_INDEX        0
+#define IMPORT_ID           1
+#define IMPORT_SPEC         2
+#define IMPORT_PRIMARY_VERB 3
+
 #define DEFAULT_ENUM_MULTI  0
 #define DEFAULT_REQUIRED    FALSE_VALUE
 #define DEFAULT_PROMPT      PROMPT_VALIDATE
@@ -13,6 +32,7 @@
 #define DEFAULT_SHOW_ABORT  0
 #define DEFAULT_SHOW_ENUM   0
 #define DEFAULT_MAX_RETRY   0
+#define DEFAULT_CACHEABLE   0
 #define DEFAULT_NEGATE      0
 
 #endif  // _COMMAND_SPEC_H
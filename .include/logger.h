@@ -34,6 +34,9 @@
 #define PROP_FILE          _EtcDir "/logger.properties"
 #endif
 
+#define PROP_FILE_REGEX    "logger\\.properties$"
+#define CONFIG_CACHE_MAX   1024
+
 #define ALLOWED_PROPS      ({ "output", "format", "level" })
 
 #define LVL_ALL            "ALL"
@@ -44,14 +47,85 @@
 #define LVL_ERROR          "ERROR"
 #define LVL_FATAL          "FATAL"
 #define LVL_OFF            "OFF"
-#define LEVELS             ([ LVL_ALL    : 7, \
-                              LVL_TRACE  : 6, \
-                              LVL_DEBUG  : 5, \
-                              LVL_INFO   : 4, \
-                              LVL_WARN   : 3, \
-                              LVL_ERROR  : 2, \
-                              LVL_FATAL  : 1, \
-                              LVL_OFF    : 0 ])
+#define LEVEL_ALL          7
+#define LEVEL_TRACE        6
+#define LEVEL_DEBUG        5
+#define LEVEL_INFO         4
+#define LEVEL_WARN         3
+#define LEVEL_ERROR        2
+#define LEVEL_FATAL        1
+#define LEVEL_OFF          0
+// marks a logger handle which must be fetched again from the factory
+#define LEVEL_STALE        8
+#define LEVELS             ([ LVL_ALL    : LEVEL_ALL,   \
+                              LVL_TRACE  : LEVEL_TRACE, \
+                              LVL_DEBUG  : LEVEL_DEBUG, \
+                              LVL_INFO   : LEVEL_INFO,  \
+                              LVL_WARN   : LEVEL_WARN,  \
+                              LVL_ERROR  : LEVEL_ERROR, \
+                              LVL_FATAL  : LEVEL_FATAL, \
+                              LVL_OFF    : LEVEL_OFF ])
+
+#define HANDLE_LEVEL       0
+#define HANDLE_LOGGER      1
+
+// Declares a cached logger handle for the program, for use by the LOG_*
+// macros. The handle is shared with the logger, which keeps its level up to
+// date, so a disabled log statement costs one comparison and its arguments
+// are never evaluated. The factory marks the handle stale when the logger is
+// released, and it is fetched again on next use, as is a handle whose 
+// logger isn't a Logger.
+#define LOGGER_HANDLE                                            \
+private nosave mixed *_log_handle = ({ LEVEL_STALE, 0 });        \
+private int _log_refresh(int level) {                            \
+  if ((_log_handle[HANDLE_LEVEL] == LEVEL_STALE)                 \
+      || !_log_handle[HANDLE_LOGGER]                             \
+      || (load_name(_log_handle[HANDLE_LOGGER]) != Logger)) {    \
+    _log_handle = LoggerFactory->get_log_handle();               \
+  }                                                              \
+  return _log_handle[HANDLE_LEVEL] >= level;                     \
+}
+
+// Usage: LOG_TRACE(("format %O", arg)); note the double parentheses. Each
+// expands to a single statement, so it's safe in an unbraced if/else.
+#define LOG_ENABLED(level) ((_log_handle[HANDLE_LEVEL] >= (level)) \
+                            && _log_refresh(level))
+#define LOG_FATAL(args)                                          \
+do {                                                             \
+  if (LOG_ENABLED(LEVEL_FATAL)) {                                \
+    _log_handle[HANDLE_LOGGER]->fatal args;                      \
+  }                                                              \
+} while (0)
+#define LOG_ERROR(args)                                          \
+do {                                                             \
+  if (LOG_ENABLED(LEVEL_ERROR)) {                                \
+    _log_handle[HANDLE_LOGGER]->error args;                      \
+  }                                                              \
+} while (0)
+#define LOG_WARN(args)                                           \
+do {                                                             \
+  if (LOG_ENABLED(LEVEL_WARN)) {                                 \
+    _log_handle[HANDLE_LOGGER]->warn args;                       \
+  }                                                              \
+} while (0)
+#define LOG_INFO(args)                                           \
+do {                                                             \
+  if (LOG_ENABLED(LEVEL_INFO)) {                                 \
+    _log_handle[HANDLE_LOGGER]->info args;                       \
+  }                                                              \
+} while (0)
+#define LOG_DEBUG(args)                                          \
+do {                                                             \
+  if (LOG_ENABLED(LEVEL_DEBUG)) {                                \
+    _log_handle[HANDLE_LOGGER]->debug args;                      \
+  }                                                              \
+} while (0)
+#define LOG_TRACE(args)                                          \
+do {                                                             \
+  if (LOG_ENABLED(LEVEL_TRACE)) {                                \
+    _log_handle[HANDLE_LOGGER]->trace args;                      \
+  }                                                              \
+} while (0)
 
 #ifdef EOTL
 #define OUT_ACMESPEC       'a'
@@ -60,6 +134,20 @@
 #define OUT_CONSOLE        'c'
 #endif
 #define OUT_FILE           'f'
+#define OUT_JSON           'j'
+
+#define LOG_BUFFER_SIZE    256
+#define LOG_FLUSH_DELAY    1
+#define CONSOLE_CACHE_TIME 60
+
+#define OVERFLOW_DROP_OLDEST 0
+#define OVERFLOW_DROP_NEWEST 1
+#define OVERFLOW_FLUSH       2
+#define DEFAULT_OVERFLOW     OVERFLOW_DROP_OLDEST
+
+#define BUFFER_MESSAGE     0
+#define BUFFER_PLAYER      1
+#define BUFFER_RECORD      2
 
 #define DEFAULT_FORMAT     "%d{%Y-%m-%d %H:%M:%S},%r %p %l - %m"
 #define DEFAULT_LEVEL      LVL_OFF
@@ -101,7 +189,7 @@
   })                                                             \
 }) })
 #define FMT_DATE      ({ "%Y-%m-%d %T", "%s", ({                 \
-  ({ #'||, ({ #'strftime, 'arg, ({ #'time }) }), "" })           \
+  ({ #'||, ({ #'[, ''dates, 'arg }), "" })                       \
 }) })
 #define FMT_LOCATION  ({ 0, "%s", ({                             \
   ({ #'?,                                                        \
@@ -131,6 +219,15 @@
   ({ #'[, ({ #'utime }), 1 })                                    \
 }) })
 
+// args passed to a compiled formatter by the logger
+#define FORMATTER_ARGS ({ 'zone, 'priority, 'message, 'caller, 'dates })
+#define FORMATTER_CLOSURE 0
+#define FORMATTER_SPECS   1
+// format specifiers which need the caller to be looked up
+#define CALLER_SPECS   ({ 'C', 'l', 'L' })
+// format specifier of formatted dates
+#define DATE_SPEC      'd'
+
 #define LOGGER_MESSAGE ([ \
   'n' : FMT_NEWLINE,      \
   'c' : FMT_CATEGORY,     \
@@ -4,4 +4,8 @@
 #define MSGCTX_SENSE              "sense"
 #define MSGCTX_EXTRA_SENSE        "extra_sense"
 
+#define HELD_DEPTH                0
+#define HELD_OUTPUT               1
+#define HELD_PROMPT               2
+
 #endif  // _MESSAGE_H
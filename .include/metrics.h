@@ -0,0 +1,35 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+#define METRIC_VERB             "verb"
+#define METRIC_CONTROLLER       "controller"
+#define METRIC_THROTTLED        "throttled"
+#define METRIC_DROPPED          "dropped"
+#define METRIC_EVAL_OVERRUN     "eval_overrun"
+#define METRIC_MEMORY_OVERRUN   "memory_overrun"
+
+#define METRICS_WINDOW          300   // seconds per histogram generation
+#define METRICS_SUB_BUCKETS     4     // histogram buckets per power of two
+#define METRICS_SUB_BITS        2
+
+#define METRIC_COUNT            0
+#define METRIC_TICKS_TOTAL      1
+#define METRIC_TICKS_MAX        2
+#define METRIC_TICKS_HIST       3
+#define METRIC_USEC_TOTAL       4
+#define METRIC_USEC_MAX         5
+#define METRIC_USEC_HIST        6
+
+#define SUMMARY_COUNT           0
+#define SUMMARY_TICKS_AVG       1
+#define SUMMARY_TICKS_P50       2
+#define SUMMARY_TICKS_P95       3
+#define SUMMARY_TICKS_P99       4
+#define SUMMARY_TICKS_MAX       5
+#define SUMMARY_USEC_AVG        6
+#define SUMMARY_USEC_P50        7
+#define SUMMARY_USEC_P95        8
+#define SUMMARY_USEC_P99        9
+#define SUMMARY_USEC_MAX        10
+
+#endif  // _METRICS_H
@@ -16,6 +16,7 @@
 #define CapabilityLib        PlatformLibDir "/capability"
 #define ClosureLib           PlatformLibDir "/closure"
 #define CommandLib           PlatformLibDir "/command"
+#define CommandParserLib     PlatformLibDir "/command_parser"
 #define CommandSpecLib       PlatformLibDir "/command_spec"
 #define ConnectionLib        PlatformLibDir "/connection"
 #define DomainLib            PlatformLibDir "/domain"
@@ -57,6 +58,7 @@
 
 #define AccessService        PlatformObjDir "/access_service"
 #define HookService          PlatformObjDir "/hook_service"
+#define MetricsService       PlatformObjDir "/metrics_service"
 #define PostalService        PlatformObjDir "/postal_service"
 #define TrackerService       PlatformObjDir "/tracker_service"
 
@@ -68,6 +70,7 @@
 #define PlatformController   PlatformObjDir "/platform_controller"
 
 #define PlatformTrackerDir   PlatformObjDir "/tracker"
+#define CommandSpecTracker   PlatformTrackerDir "/command_spec"
 #define ConnectionTracker    PlatformTrackerDir "/connection"
 #define DomainTracker        PlatformTrackerDir "/domain"
 #define FileTracker          PlatformTrackerDir "/file"
@@ -0,0 +1,18 @@
+#ifndef _RATE_LIMIT_H
+#define _RATE_LIMIT_H
+
+// used when no domain configures a limit for the user class
+#define DEFAULT_RATE_LIMIT_RATE   4.0   // commands per second
+#define DEFAULT_RATE_LIMIT_BURST  20    // bucket size, in commands
+#define DEFAULT_RATE_LIMIT_QUEUE  50    // max pending commands
+
+#define RATE_LIMIT_RATE           0
+#define RATE_LIMIT_BURST          1
+#define RATE_LIMIT_QUEUE          2
+
+// the domain.xml rateLimit class attribute, "" applies to every class
+#define USER_CLASS_ANY            ""
+#define USER_CLASS_GUEST          "guest"
+#define USER_CLASS_USER           "user"
+
+#endif  // _RATE_LIMIT_H
@@ -5,11 +5,13 @@
  * @alias ArgumentLib
  */
 #pragma no_clone
+#include <string.h>
 #include <argument.h>
 
 private inherit StringLib;
 private inherit ArrayLib;
 
+protected mixed *tokenize_args(string arg);
 protected varargs string *explode_args(string arg, int preserve_quotes);
 private int _find_close_char(string str, int start, string open,
                              string close, int len, int style, string both);
@@ -19,6 +21,73 @@ protected string *explode_unescaped(string str, string delim);
 protected varargs string *explode_nested(string str, string delim,
                                          string open, string close);
 
+/**
+ * Split an argument string into tokens in a single pass. Tokens are separated
+ * by unescaped spaces, but quoted strings are kept together. Each token is an
+ * array of the form <code>({ int kind, string text, string value, int start,
+ * int end })</code>, where text is the token exactly as it appears in the
+ * argument string between the start and end offsets (inclusive), and value
+ * is the token with its quotes removed and escapes resolved. The kind is one
+ * of TOKEN_WORD, TOKEN_QUOTED, TOKEN_OPT ("-x"), TOKEN_LONGOPT ("--name"),
+ * or TOKEN_END_OPTS ("--").
+ *
+ * @param  arg the argument string
+ * @return     an array of tokens
+ */
+protected mixed *tokenize_args(string arg) {
+  mixed *result = ({ });
+  if (!arg) { return result; }
+
+  int len = strlen(arg);
+  int pos = find_nonws(arg, 0);
+  while (pos < len) {
+    int start = pos;
+    int quote = (member(QUOTE_CHARS, arg[pos]) != -1) ? arg[pos] : 0;
+    int term = quote || ' ';
+    int seg = (quote ? pos + 1 : pos);
+    string value = "";
+    int i;
+    for (i = seg; i < len; i++) {
+      int c = arg[i];
+      if (c == '\\') {
+        // keep the escaped char, drop the backslash
+        value += arg[seg..(i - 1)] + arg[(i + 1)..(i + 1)];
+        seg = ++i + 1;
+      } else if (c == term) {
+        break;
+      }
+    }
+    value += arg[seg..(i - 1)];
+
+    int kind, end;
+    if (!quote) {
+      end = i - 1;
+      kind = TOKEN_WORD;
+      if (arg[start] == '-') {
+        if ((end == start + 1) && (arg[end] == '-')) {
+          kind = TOKEN_END_OPTS;
+        } else if ((end > start + 1) && (arg[start + 1] == '-')) {
+          kind = TOKEN_LONGOPT;
+        } else {
+          kind = TOKEN_OPT;
+        }
+      }
+    } else if (i < len) {
+      end = i;
+      kind = TOKEN_QUOTED;
+    } else {
+      // unterminated quote, keep the quote char
+      end = len - 1;
+      kind = TOKEN_WORD;
+      value = arg[start..start] + value;
+    }
+
+    result += ({ ({ kind, arg[start..end], value, start, end }) });
+    pos = find_nonws(arg, end + 1);
+  }
+  return result;
+}
+
 /**
  * Separate space-deliniated arguments, but keep quoted strings together.
  *
@@ -29,22 +98,8 @@ protected varargs string *explode_nested(string str, string delim,
  *                         quoted strings returned as a single argument
  */
 protected varargs string *explode_args(string arg, int preserve_quotes) {
-  string *args = ({ });
-  if (!arg) { return args; }
-
-  int pos = 0;
-  int len = strlen(arg);
-  while (pos < len) {
-    pos = find_nonws(arg, pos);
-    int newpos = match_quote(arg, pos);
-    if (preserve_quotes) {
-      args += ({ arg[pos..newpos] });
-    } else {
-      args += ({ unescape(unquote(arg[pos..newpos])) });
-    }
-    pos = newpos + 1;
-  }
-  return args;
+  return map(tokenize_args(arg), #'[, //'
+             (preserve_quotes ? TOKEN_TEXT : TOKEN_VALUE));
 }
 
 /**
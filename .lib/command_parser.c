@@ -0,0 +1,435 @@
+/**
+ * Library for generating dedicated parser programs from a command spec file.
+ * A command opts in to a generated parser with the parser attribute of its
+ * &lt;command&gt; tag, giving the path of the program relative to the spec
+ * file. The generated program matches the opts and extracts the args of each
+ * of the command's syntaxes with straight-line code, in place of the table
+ * driven apply_syntax() of CommandLib, and is used by the CommandController
+ * for as long as it was generated from the current version of the spec.
+ * CommandSpecTracker generates the parsers of a spec the first time one is
+ * needed, and again after the spec changes.
+ *
+ * @author devo
+ * @alias CommandParserLib
+ */
+#pragma no_clone
+#include <command_spec.h>
+#include <command.h>
+
+inherit CommandSpecLib;
+
+int generate_command_parsers(string specfile);
+int write_parser(string file, string source);
+string generate_parser(string specfile, string digest, mixed *command);
+string generate_syntax(mixed *syntax, int index, string opts_var);
+string generate_opts_parser(string name, mapping valid_opts,
+                            mapping valid_longopts);
+string generate_args(mixed *syntax);
+string generate_numargs_check(mixed *syntax);
+string opt_literal(int opt);
+
+/**
+ * Generate the parser programs for every command of a command specfile
+ * which has a parser attribute. Imported commands are skipped; their
+ * parsers are generated from the spec which defines them. Previously loaded
+ * versions of the parsers are destructed so the new ones are compiled on
+ * next use.
+ *
+ * @param  specfile      the spec filename
+ * @return the number of parser programs written
+ */
+int generate_command_parsers(string specfile) {
+  mixed *compiled = load_compiled_spec(specfile);
+  int result = 0;
+  foreach (mixed *command : compiled[COMPILED_COMMANDS]) {
+    if (!command || !command[COMMAND_PARSER]) {
+      continue;
+    }
+    string source =
+      generate_parser(specfile, compiled[COMPILED_HASH], command);
+    if (write_parser(command[COMMAND_PARSER] + ".c", source)) {
+      object old = find_object(command[COMMAND_PARSER]);
+      if (old) {
+        destruct(old);
+      }
+      result++;
+    }
+  }
+  return result;
+}
+
+/**
+ * Write the source of a generated parser program, replacing any previous
+ * version of it.
+ *
+ * @param  file          the program filename
+ * @param  source        the program source
+ * @return 1 for success, 0 for failure
+ */
+int write_parser(string file, string source) {
+  int written;
+  string err = catch(
+    written = ((!file_exists(file) || rm(file)) && write_file(file, source));
+    nolog);
+  if (err || !written) {
+    logger->info("unable to write generated parser %s: %s", file, 
+                 err || "write failed\n");
+    return 0;
+  }
+  return 1;
+}
+
+/**
+ * Generate the parser program for a command. The program's parse_syntax()
+ * function scores the command's syntaxes in the same order and by the same
+ * rules as apply_syntax(), so either may be used for the same result. The
+ * opts section is parsed once for each distinct set of valid opts.
+ *
+ * @param  specfile      the spec filename
+ * @param  digest        the content hash of the spec file the command was
+ *                       compiled from
+ * @param  command       the compiled command
+ * @return the program source
+ */
+string generate_parser(string specfile, string digest, mixed *command) {
+  // ([ str signature : str opts_var ])
+  mapping signatures = ([ ]);
+  string opts_parsers = "";
+  string prototypes = "";
+  string body = "";
+  int index = 0;
+  foreach (mixed *syntax : command[COMMAND_SYNTAX]) {
+    string signature = syntax[SYNTAX_OPT_SIGNATURE];
+    string opts_var = signatures[signature];
+    if (!opts_var) {
+      int n = sizeof(signatures);
+      string name = "parse_opts_" + n;
+      opts_var = "opts" + n;
+      signatures[signature] = opts_var;
+      prototypes += sprintf("private void %s(mixed *tokens, int index, "
+                            "mapping opts,\n%*s mapping badopts);\n",
+                            name, strlen(name) + 13, "");
+      opts_parsers += "\n" + generate_opts_parser(name,
+        syntax[SYNTAX_VALID_OPTS], syntax[SYNTAX_VALID_LONGOPTS]);
+      body += sprintf("\n  // opts %Q\n"
+                      "  int index%d = 0;\n"
+                      "  mapping %s = ([ ]), bad%s = ([ ]);\n"
+                      "  %s(tokens, &index%d, &%s, &bad%s);\n",
+                      signature, n, opts_var, opts_var, name, n, opts_var,
+                      opts_var);
+    }
+    body += generate_syntax(syntax, index++, opts_var);
+  }
+
+  return sprintf(
+"// Parser for the %Q command, generated from %Q.\n"
+"// Don't edit this file, CommandSpecTracker generates it again whenever\n"
+"// the spec changes.\n"
+"#pragma no_clone\n"
+"#include <sys/regexp.h>\n"
+"#include <command.h>\n"
+"#include <argument.h>\n"
+"\n"
+"private inherit ArgumentLib;\n"
+"\n"
+"public string query_spec_hash();\n"
+"public mixed *parse_syntax(string arg);\n"
+"%s"
+"\n"
+"/**\n"
+" * Return the content hash of the spec this parser was generated from.\n"
+" *\n"
+" * @return the spec hash\n"
+" */\n"
+"public string query_spec_hash() {\n"
+"  return %Q;\n"
+"}\n"
+"\n"
+"/**\n"
+" * Apply the command's syntaxes to an argument string.\n"
+" *\n"
+" * @param  arg           the command line argument string\n"
+" * @return the syntax index, opts, badopts, and args of the syntax which\n"
+" *         was applied; see GENERATED_* in command.h\n"
+" */\n"
+"public mixed *parse_syntax(string arg) {\n"
+"  mixed *tokens = tokenize_args(arg);\n"
+"  int numtokens = sizeof(tokens);\n"
+"  mixed *best;\n"
+"  int best_numargs;\n"
+"%s"
+"  return best;\n"
+"}\n"
+"%s",
+    command[COMMAND_VERBS][0], specfile, prototypes, digest, body,
+    opts_parsers);
+}
+
+/**
+ * Generate the code applying one syntax. An exact match returns straight
+ * away. Otherwise a match on the number of args replaces the best result so
+ * far if it has fewer bad opts, or if the best result so far didn't match
+ * the number of args either; and the first syntax is kept if nothing does.
+ *
+ * @param  syntax        the compiled syntax
+ * @param  index         the position of the syntax in the command
+ * @param  opts_var      the variable holding the parsed opts for the syntax
+ * @return the generated code
+ */
+string generate_syntax(mixed *syntax, int index, string opts_var) {
+  string index_var = "index" + opts_var[4..];
+  string strategy = ({ "explode", "sscanf", "regexp", "parse_command" })
+                    [syntax[SYNTAX_STRATEGY]];
+  return sprintf("\n  // syntax %d, %s\n"
+                 "  {\n"
+                 "    int index = %s;\n"
+                 "    mapping opts = %s, badopts = bad%s;\n"
+                 "    string *args;\n"
+                 "%s"
+                 "    mixed *parsed = ({ %d, opts, badopts, args });\n"
+                 "    if (%s) {\n"
+                 "      if (!sizeof(badopts)) {\n"
+                 "        return parsed;\n"
+                 "      }\n"
+                 "      if (!best || !best_numargs\n"
+                 "          || (sizeof(badopts) < "
+                 "sizeof(best[GENERATED_BADOPTS]))) {\n"
+                 "        best = parsed;\n"
+                 "        best_numargs = 1;\n"
+                 "      }\n"
+                 "    } else if (!best) {\n"
+                 "      best = parsed;\n"
+                 "    }\n"
+                 "  }\n",
+                 index, strategy, index_var, opts_var, opts_var,
+                 generate_args(syntax), index,
+                 generate_numargs_check(syntax));
+}
+
+/**
+ * Generate an opts parser function for a set of valid opts. The generated
+ * function behaves the same as parse_opts() of CommandLib, with the valid
+ * opts switched on directly.
+ *
+ * @param  name           the function name
+ * @param  valid_opts     all the valid opts
+ * @param  valid_longopts all the valid longopts
+ * @return the generated function
+ */
+string generate_opts_parser(string name, mapping valid_opts,
+                            mapping valid_longopts) {
+  string opt_cases = "";
+  foreach (int opt : sort_array(m_indices(valid_opts), #'>)) { //'
+    string key = opt_literal(opt);
+    if (valid_opts[opt][OPT_PARAM]) {
+      opt_cases += sprintf(
+"          case %s:\n"
+"            opts[%s] = (opts[%s] || ({ }))\n"
+"              + ({ (i < len - 1) ? value[(i + 1)..]\n"
+"                   : ((index < numtokens) ? tokens[index++][TOKEN_VALUE]\n"
+"                                          : 0) });\n"
+"            i = len;\n"
+"            break;\n", key, key, key);
+    } else {
+      opt_cases += sprintf(
+"          case %s:\n"
+"            opts[%s] = (opts[%s] || ({ })) + ({ 0 });\n"
+"            break;\n", key, key, key);
+    }
+  }
+
+  string longopt_cases = "";
+  foreach (string opt : sort_array(m_indices(valid_longopts), #'>)) { //'
+    string key = sprintf("%Q", opt);
+    if (valid_longopts[opt][OPT_PARAM]) {
+      longopt_cases += sprintf(
+"          case %s:\n"
+"            opts[%s] = (opts[%s] || ({ }))\n"
+"              + ({ (index < numtokens) ? tokens[index++][TOKEN_VALUE] "
+": \"\" });\n"
+"            break;\n", key, key, key);
+    } else {
+      longopt_cases += sprintf(
+"          case %s:\n"
+"            opts[%s] = (opts[%s] || ({ })) + ({ 0 });\n"
+"            break;\n", key, key, key);
+    }
+  }
+
+  return sprintf(
+"\n"
+"/**\n"
+" * Parse the opts section of the tokenized argument string.\n"
+" *\n"
+" * @param  tokens         the argument string tokens\n"
+" * @param  index          the token index to begin search, passed by\n"
+" *                        reference and assigned the index of the first\n"
+" *                        token after the opts section\n"
+" * @param  opts           the parsed opts, passed by reference\n"
+" * @param  badopts        the bad opts, passed by reference\n"
+" */\n"
+"private void %s(mixed *tokens, int index, mapping opts,\n"
+"%*s mapping badopts) {\n"
+"  int numtokens = sizeof(tokens);\n"
+"  while (index < numtokens) {\n"
+"    mixed *token = tokens[index];\n"
+"    switch (token[TOKEN_KIND]) {\n"
+"      case TOKEN_OPT:\n"
+"        index++;\n"
+"        string value = token[TOKEN_VALUE];\n"
+"        int len = strlen(value);\n"
+"        for (int i = 1; i < len; i++) {\n"
+"          switch (value[i]) {\n"
+"%s"
+"          default:\n"
+"            badopts[value[i]] = 1;\n"
+"            break;\n"
+"          }\n"
+"        }\n"
+"        break;\n"
+"      case TOKEN_LONGOPT:\n"
+"        index++;\n"
+"        switch (token[TOKEN_VALUE][2..]) {\n"
+"%s"
+"          default:\n"
+"            badopts[token[TOKEN_VALUE][2..]] = 1;\n"
+"            break;\n"
+"        }\n"
+"        break;\n"
+"      case TOKEN_END_OPTS:\n"
+"        // no more opts\n"
+"        index++;\n"
+"        return;\n"
+"      default:\n"
+"        // found an arg\n"
+"        return;\n"
+"    }\n"
+"  }\n"
+"}\n",
+    name, strlen(name) + 13, "", opt_cases, longopt_cases);
+}
+
+/**
+ * Generate the code extracting the argument list for a syntax into the
+ * args variable, following parse_args() of CommandLib. The generated code
+ * starts from the index variable, the token index of the first argument.
+ *
+ * @param  syntax        the compiled syntax
+ * @return the generated code
+ */
+string generate_args(mixed *syntax) {
+  string pattern = sprintf("%Q", syntax[SYNTAX_PATTERN] || "");
+  string rest =
+"    string rest = ((index < numtokens) ? arg[tokens[index][TOKEN_START]..]\n"
+"                                       : \"\");\n";
+  switch (syntax[SYNTAX_STRATEGY]) {
+    case STRATEGY_SSCANF:
+      int numargs = count_conversions(syntax[SYNTAX_PATTERN], ({ '*' }));
+      string *vars = allocate(numargs);
+      for (int i = 0; i < numargs; i++) {
+        vars[i] = "arg" + i;
+      }
+      if (!numargs) {
+        return "    args = ({ });\n";
+      }
+      return sprintf(
+"%s"
+"    mixed %s;\n"
+"    int matches = sscanf(rest, %s, %s);\n"
+"    args = ({ %s })[0..(matches - 1)];\n",
+        rest, implode(vars, ", "), pattern, implode(vars, ", "),
+        implode(vars, ", "));
+
+    case STRATEGY_REGEXP:
+      return sprintf(
+"%s"
+"    string *matches = regmatch(rest, %s, RE_MATCH_SUBS);\n"
+"    args = (matches ? matches[1..] : ({ }));\n",
+        rest, pattern);
+
+    case STRATEGY_PARSE_COMMAND:
+      int numargs = count_conversions(syntax[SYNTAX_PATTERN], ({ }));
+      string *vars = allocate(numargs);
+      for (int i = 0; i < numargs; i++) {
+        vars[i] = "arg" + i;
+      }
+      if (!numargs) {
+        return "    args = ({ });\n";
+      }
+      return sprintf(
+"%s"
+"    mixed %s;\n"
+"    if (parse_command(rest, ({ }), %s, %s)) {\n"
+"      // arguments after the first unmatched conversion are dropped\n"
+"      args = ({ %s });\n"
+"      int i = member(args, UNMATCHED_ARG);\n"
+"      if (i >= 0) {\n"
+"        args = args[0..(i - 1)];\n"
+"      }\n"
+"    } else {\n"
+"      args = ({ });\n"
+"    }\n",
+        rest, implode(map(vars, (: $1 + " = UNMATCHED_ARG" :)), ", "),
+        pattern, implode(vars, ", "), implode(vars, ", "));
+
+    case STRATEGY_EXPLODE:
+    default:
+      int limit = syntax[SYNTAX_EXPLODE_ARGS];
+      if (limit < 0) {
+        return "    args = map(tokens[index..], #'[, TOKEN_VALUE); //'\n";
+      }
+      if (limit == 0) {
+        return "    args = ({ });\n";
+      }
+      if (limit == 1) {
+        return
+"    args = ((numtokens - index <= 1)\n"
+"            ? map(tokens[index..], #'[, TOKEN_VALUE) //'\n"
+"            : ({ arg[tokens[index][TOKEN_START]..] }));\n";
+      }
+      // hard arg limit, last arg consumes the rest of the string verbatim
+      return sprintf(
+"    if (numtokens - index <= %d) {\n"
+"      args = map(tokens[index..], #'[, TOKEN_VALUE); //'\n"
+"    } else {\n"
+"      args = map(tokens[index..(index + %d)], #'[, TOKEN_VALUE) //'\n"
+"             + ({ arg[tokens[index + %d][TOKEN_START]..] });\n"
+"    }\n",
+        limit, limit - 2, limit - 1);
+  }
+  return 0;
+}
+
+/**
+ * Generate the condition checking the number of args against the bounds of
+ * a syntax.
+ *
+ * @param  syntax        the compiled syntax
+ * @return the generated condition
+ */
+string generate_numargs_check(mixed *syntax) {
+  string *checks = ({ });
+  if (syntax[SYNTAX_MIN_NUMARGS] > 0) {
+    checks += ({ sprintf("(sizeof(args) >= %d)",
+                         syntax[SYNTAX_MIN_NUMARGS]) });
+  }
+  if (syntax[SYNTAX_MAX_NUMARGS] >= 0) {
+    checks += ({ sprintf("(sizeof(args) <= %d)",
+                         syntax[SYNTAX_MAX_NUMARGS]) });
+  }
+  return (sizeof(checks) ? implode(checks, " && ") : "1");
+}
+
+/**
+ * Get the LPC literal for an opt character.
+ *
+ * @param  opt           the opt character
+ * @return a character literal, or the character code for characters which
+ *         would need escaping
+ */
+string opt_literal(int opt) {
+  if ((opt == '\'') || (opt == '\\') || (opt < ' ') || (opt > '~')) {
+    return to_string(opt);
+  }
+  return sprintf("'%c'", opt);
+}
@@ -5,6 +5,9 @@
  * @alias CommandSpecLib
  */
 #pragma no_clone
+#include <sys/files.h>
+#include <sys/regexp.h>
+#include <sys/tls.h>
 #include <sys/xml.h>
 #include <command_spec.h>
 #include <command.h>
@@ -14,7 +17,18 @@ inherit FileLib;
 object logger = LoggerFactory->get_logger(THISO);
 
 mixed *load_command_spec(string specfile);
-mixed *parse_commands_xml(string specfile, mixed *xml);
+mixed *load_command_index(string specfile);
+mixed *materialize_command(mixed *command);
+string *unknown_validators(mixed *command, object controller);
+mixed *load_compiled_spec(string specfile);
+mixed *restore_compiled_spec(string specfile);
+int valid_compiled_spec(mixed *compiled);
+void save_compiled_spec(string specfile, mixed *compiled);
+void compile_parsers(string specfile, mixed *commands, int strip);
+varargs mixed *link_commands(string specfile, mixed *commands, 
+                             mixed *imports, int lazy);
+mixed *parse_commands_xml(string specfile, mixed *xml, mixed *imports);
+mixed *parse_index_xml(string specfile, mixed *xml, mixed *imports);
 varargs mixed *parse_command_xml(string specfile, mixed *xml, 
                                  mapping subcommand_map);
 mixed *parse_fields_xml(string specfile, mixed *xml, mapping field_map);
@@ -32,8 +46,15 @@ mixed *parse_validate_xml(string specfile, mixed *xml);
 mixed *parse_syntax_xml(string specfile, mixed *xml, mapping field_map,
                         mapping arg_lists, mapping opt_sets, 
                         mapping subcommand_map);
-mixed *parse_import_xml(string specfile, mixed *xml, mapping imports);
+mixed *compile_syntax(string specfile, mixed *syntax);
+closure compile_parser(string specfile, int strategy, string pattern);
+int count_conversions(string pattern, int *suppress);
+mixed *parse_import_xml(string specfile, mixed *xml);
+varargs mixed *resolve_import(string specfile, mixed *import, 
+                              mapping imports, int lazy);
 int parse_boolean(string value);
+string parse_parser_path(string specfile, string parser);
+int *parse_budget(string specfile, mapping attributes);
 void parse_error(string specfile, string msg);
 
 /**
@@ -44,39 +65,325 @@ void parse_error(string specfile, string msg);
  * @return the loaded commands
  */
 mixed *load_command_spec(string specfile) {
-  mixed *xml = xml_parse(read_file(specfile));
-  return parse_commands_xml(specfile, xml);
+  mixed *compiled = load_compiled_spec(specfile);
+  return link_commands(specfile, compiled[COMPILED_COMMANDS], 
+                       compiled[COMPILED_IMPORTS]);
 }
 
 /**
- * Parse the &lt;commands&gt; tag.
+ * Load the command index of a command specfile. This is the cheap first 
+ * phase of loading a spec: each command in the index only has its id, 
+ * controller, and verbs, along with where it was defined. The rest of the 
+ * command is built by materialize_command() the first time it's needed. A 
+ * fresh compiled spec is used if there is one, otherwise only the command
+ * tag attributes are read from the spec file.
  * 
  * @param  specfile      the spec filename
- * @param  xml           the deserialized xml to parse
+ * @return the indexed commands
+ */
+mixed *load_command_index(string specfile) {
+  mixed *dates = get_dir(specfile, GETDIR_DATES);
+  int mtime = (sizeof(dates) ? dates[0] : 0);
+  mixed *commands, *imports;
+  mixed *compiled = restore_compiled_spec(specfile);
+  if (compiled && (compiled[COMPILED_MTIME] == mtime)) {
+    commands = ({ });
+    foreach (mixed *command : compiled[COMPILED_COMMANDS]) {
+      // imports are left as 0 placeholders
+      commands += ({ command ? (command[COMMAND_ID..COMMAND_VERBS] 
+                                + ({ 0, 0, 0, 0 }) 
+                                + command[COMMAND_SPECFILE..COMMAND_CACHEABLE])
+                             : 0 });
+    }
+    imports = compiled[COMPILED_IMPORTS];
+  } else {
+    string source = read_file(specfile);
+    if (!source) {
+      parse_error(specfile, "unable to read file");
+    }
+    imports = ({ });
+    commands = parse_index_xml(specfile, xml_parse(source), &imports);
+  }
+  return link_commands(specfile, commands, imports, 1);
+}
+
+/**
+ * Build the full definition of an indexed command, see load_command_index().
+ * The command is updated in place, so every holder of the indexed command 
+ * sees the full definition from then on. Commands which are already fully
+ * built are returned as is.
+ * 
+ * @param  command       the indexed command
+ * @return the full command, or 0 if the spec it was defined in no longer
+ *         defines it
+ */
+mixed *materialize_command(mixed *command) {
+  if (pointerp(command[COMMAND_SYNTAX])) {
+    return command;
+  }
+  mixed *compiled = load_compiled_spec(command[COMMAND_SPECFILE]);
+  mixed *commands = compiled[COMPILED_COMMANDS];
+  int pos = command[COMMAND_POSITION];
+  if ((pos >= sizeof(commands)) || !commands[pos]
+      || (commands[pos][COMMAND_VERBS][0] != command[COMMAND_VERBS][0])) {
+    return 0;
+  }
+  // keep the id and controller, which may have been changed by an import
+  command[COMMAND_FIELDS..COMMAND_MAX_RETRY] = 
+    commands[pos][COMMAND_FIELDS..COMMAND_MAX_RETRY];
+  return command;
+}
+
+/**
+ * Find the validators used by a command which aren't defined by its 
+ * controller.
+ * 
+ * @param  command       the full command
+ * @param  controller    the command's controller
+ * @return the names of the unknown validators
+ */
+string *unknown_validators(mixed *command, object controller) {
+  mixed *validations = command[COMMAND_VALIDATION];
+  foreach (mixed *field : command[COMMAND_FIELDS]) {
+    validations += field[FIELD_VALIDATION];
+  }
+  foreach (mixed *syntax : command[COMMAND_SYNTAX]) {
+    validations += syntax[SYNTAX_VALIDATION];
+  }
+  string *result = ({ });
+  foreach (mixed *validation : validations) {
+    string validator = validation[VALIDATE_VALIDATOR];
+    if (!function_exists(VALIDATION_PREFIX + validator, controller)
+        && (member(result, validator) == -1)) {
+      result += ({ validator });
+    }
+  }
+  return result;
+}
+
+/**
+ * Load the compiled form of a command specfile. The compiled form is saved 
+ * next to the spec file, and reused for as long as the spec file's mtime or
+ * content hash match the ones it was compiled from. Otherwise the spec file
+ * is parsed and the compiled form is saved again. Imports are left 
+ * unresolved in the compiled form, see link_commands().
+ * 
+ * @param  specfile      the spec filename
+ * @return the compiled spec; see COMPILED_* in command_spec.h
+ */
+mixed *load_compiled_spec(string specfile) {
+  mixed *dates = get_dir(specfile, GETDIR_DATES);
+  int mtime = (sizeof(dates) ? dates[0] : 0);
+  mixed *compiled = restore_compiled_spec(specfile);
+  if (compiled && (compiled[COMPILED_MTIME] == mtime)
+      && !catch(compile_parsers(specfile, compiled[COMPILED_COMMANDS], 0);
+                nolog)) {
+    return compiled;
+  }
+
+  string source = read_file(specfile);
+  if (!source) {
+    parse_error(specfile, "unable to read file");
+  }
+  string digest = hash(TLS_HASH_MD5, source);
+  if (compiled && (compiled[COMPILED_HASH] == digest)
+      && !catch(compile_parsers(specfile, compiled[COMPILED_COMMANDS], 0);
+                nolog)) {
+    // touched but unchanged
+    compiled[COMPILED_MTIME] = mtime;
+    save_compiled_spec(specfile, compiled);
+    return compiled;
+  }
+
+  mixed *imports = ({ });
+  mixed *commands = parse_commands_xml(specfile, xml_parse(source), &imports);
+  compiled = ({ COMPILED_SPEC_VERSION, mtime, digest, commands, imports });
+  save_compiled_spec(specfile, compiled);
+  return compiled;
+}
+
+/**
+ * Restore the saved compiled form of a command specfile.
+ * 
+ * @param  specfile      the spec filename
+ * @return the compiled spec, or 0 if there isn't a usable one
+ */
+mixed *restore_compiled_spec(string specfile) {
+  mixed *compiled;
+  if (catch(compiled = read_value(specfile + COMPILED_SPEC_SUFFIX); nolog) 
+      || !valid_compiled_spec(compiled)) {
+    return 0;
+  }
+  return compiled;
+}
+
+/**
+ * Sanity check a compiled spec restored from disk.
+ * 
+ * @param  compiled      the restored value
+ * @return 1 if the value looks like a compiled spec of the current version, 
+ *         otherwise 0
+ */
+int valid_compiled_spec(mixed *compiled) {
+  return pointerp(compiled) 
+         && (sizeof(compiled) == COMPILED_SIZE)
+         && (compiled[COMPILED_VERSION] == COMPILED_SPEC_VERSION)
+         && intp(compiled[COMPILED_MTIME])
+         && stringp(compiled[COMPILED_HASH])
+         && pointerp(compiled[COMPILED_COMMANDS])
+         && pointerp(compiled[COMPILED_IMPORTS]);
+}
+
+/**
+ * Save the compiled form of a command specfile next to the spec file.
+ * Parser closures can't be saved, so they are stripped from the saved copy
+ * and compiled again when it is restored. Failing to save isn't an error,
+ * the spec will just be parsed again next time.
+ * 
+ * @param  specfile      the spec filename
+ * @param  compiled      the compiled spec
+ */
+void save_compiled_spec(string specfile, mixed *compiled) {
+  mixed *value = deep_copy(compiled);
+  compile_parsers(specfile, value[COMPILED_COMMANDS], 1);
+  string cachefile = specfile + COMPILED_SPEC_SUFFIX;
+  string err = catch(write_value(cachefile, value); nolog);
+  if (err) {
+    logger->info("unable to save compiled spec %s: %s", cachefile, err);
+  }
+}
+
+/**
+ * Compile the parser closures for every pattern syntax of some commands and
+ * their subcommands, or strip them out.
+ * 
+ * @param  specfile      the spec filename
+ * @param  commands      the commands, updated in place
+ * @param  strip         1 to remove the parsers instead of compiling them
+ */
+void compile_parsers(string specfile, mixed *commands, int strip) {
+  foreach (mixed *command : commands) {
+    if (!command) {
+      // unresolved import
+      continue;
+    }
+    foreach (mixed *syntax : command[COMMAND_SYNTAX]) {
+      if (syntax[SYNTAX_STRATEGY] != STRATEGY_EXPLODE) {
+        syntax[SYNTAX_PARSER] = 
+          (strip ? 0 : compile_parser(specfile, syntax[SYNTAX_STRATEGY], 
+                                      syntax[SYNTAX_PATTERN]));
+      }
+      compile_parsers(specfile, syntax[SYNTAX_SUBCOMMANDS], strip);
+    }
+  }
+}
+
+/**
+ * Resolve the imports of a compiled spec or command index, producing the 
+ * loaded commands.
+ * 
+ * @param  specfile      the spec filename
+ * @param  commands      the commands, with a 0 placeholder for each import
+ * @param  imports       the imports; see IMPORT_* in command_spec.h
+ * @param  lazy          1 to import indexed commands rather than full ones
  * @return the loaded commands
  */
-mixed *parse_commands_xml(string specfile, mixed *xml) {
+varargs mixed *link_commands(string specfile, mixed *commands, 
+                             mixed *imports, int lazy) {
+  mapping resolved = ([ ]);
+  foreach (mixed *import : imports) {
+    commands[import[IMPORT_INDEX]] = 
+      resolve_import(specfile, import, &resolved, lazy);
+  }
+  return commands - ({ 0 });
+}
+
+/**
+ * Parse the &lt;commands&gt; tag. Imports aren't resolved here; the command
+ * list gets a 0 placeholder for each import, and the import is appended to
+ * the imports array instead.
+ * 
+ * @param  specfile      the spec filename
+ * @param  xml           the deserialized xml to parse
+ * @param  imports       the array of imports, passed by reference; see 
+ *                       IMPORT_* in command_spec.h
+ * @return the parsed commands
+ */
+mixed *parse_commands_xml(string specfile, mixed *xml, mixed *imports) {
   xml[XML_TAG_ATTRIBUTES] ||= ([ ]);
 
   if (xml[XML_TAG_NAME] != "commands") {
     parse_error(specfile, "unknown document root");
   }
 
-  mapping imports = ([ ]);
   mixed *commands = ({ });
   foreach (mixed *el : xml[XML_TAG_CONTENTS]) {
     switch (el[XML_TAG_NAME]) {
       case "command":
         mixed *command = parse_command_xml(specfile, el);
         if (command) {
-          commands += ({ command });
+          command[COMMAND_POSITION] = sizeof(commands);
         }
+        commands += ({ command });
         break;
       case "import":
-        mixed *command = parse_import_xml(specfile, el, imports);
-        if (command) {
-          commands += ({ command });
+        imports += ({ ({ sizeof(commands) }) 
+                      + parse_import_xml(specfile, el) });
+        commands += ({ 0 });
+        break;
+      default:
+        parse_error(specfile, "unknown element " + el[XML_TAG_NAME]);
+        break;
+    }
+  }
+
+  return commands;
+}
+
+/**
+ * Read the command index out of the &lt;commands&gt; tag, see 
+ * load_command_index(). Only the attributes of each command tag are read.
+ * Commands are placed the same as parse_commands_xml() would place them.
+ * 
+ * @param  specfile      the spec filename
+ * @param  xml           the deserialized xml to parse
+ * @param  imports       the array of imports, passed by reference; see 
+ *                       IMPORT_* in command_spec.h
+ * @return the indexed commands
+ */
+mixed *parse_index_xml(string specfile, mixed *xml, mixed *imports) {
+  xml[XML_TAG_ATTRIBUTES] ||= ([ ]);
+
+  if (xml[XML_TAG_NAME] != "commands") {
+    parse_error(specfile, "unknown document root");
+  }
+
+  mixed *commands = ({ });
+  foreach (mixed *el : xml[XML_TAG_CONTENTS]) {
+    el[XML_TAG_ATTRIBUTES] ||= ([ ]);
+    switch (el[XML_TAG_NAME]) {
+      case "command":
+        mapping attributes = el[XML_TAG_ATTRIBUTES];
+        if (!member(attributes, "controller")) {
+          parse_error(specfile, "missing attribute controller");
+        }
+        if (!member(attributes, "primaryVerb")) {
+          parse_error(specfile, "missing attribute primaryVerb");
         }
+        commands += ({ ({ attributes["id"], attributes["controller"], 
+                          ({ attributes["primaryVerb"] }), 0, 0, 0, 0, 
+                          specfile, sizeof(commands), 
+                          parse_parser_path(specfile, attributes["parser"]), 
+                          parse_budget(specfile, attributes), 
+                          (member(attributes, "cacheable") 
+                           ? parse_boolean(attributes["cacheable"]) 
+                           : DEFAULT_CACHEABLE) 
+                       }) });
+        break;
+      case "import":
+        imports += ({ ({ sizeof(commands) }) 
+                      + parse_import_xml(specfile, el) });
+        commands += ({ 0 });
         break;
       default:
         parse_error(specfile, "unknown element " + el[XML_TAG_NAME]);
@@ -133,6 +440,15 @@ varargs mixed *parse_command_xml(string specfile, mixed *xml,
     max_retry = to_int(xml[XML_TAG_ATTRIBUTES]["maxRetry"]);
   } 
 
+  string parser = 
+    parse_parser_path(specfile, xml[XML_TAG_ATTRIBUTES]["parser"]);
+  int *budget = parse_budget(specfile, xml[XML_TAG_ATTRIBUTES]);
+
+  int cacheable = DEFAULT_CACHEABLE;
+  if (member(xml[XML_TAG_ATTRIBUTES], "cacheable")) {
+    cacheable = parse_boolean(xml[XML_TAG_ATTRIBUTES]["cacheable"]);
+  }
+
   mixed *fields = ({ });
   mapping arg_lists = ([ ]);
   mapping opt_sets = ([ ]);
@@ -181,7 +497,8 @@ varargs mixed *parse_command_xml(string specfile, mixed *xml,
     }
   }
 
-  return ({ id, controller, verbs, fields, syntax, validation, max_retry });
+  return ({ id, controller, verbs, fields, syntax, validation, max_retry, 
+            specfile, 0, parser, budget, cacheable });
 }
 
 /**
@@ -402,9 +719,12 @@ mixed *parse_opt_xml(string specfile, mixed *xml, mapping field_map) {
     result = parse_field_xml(specfile, xml);
   }
 
+  string opt;
   if (member(xml[XML_TAG_ATTRIBUTES], "param")) {
-    result += ({ xml[XML_TAG_ATTRIBUTES]["param"] });
+    opt = xml[XML_TAG_ATTRIBUTES]["param"];
   } 
+  // every field type but bool takes a parameter
+  result += ({ opt, (result[FIELD_TYPE] != "bool") });
 
   if (member(xml[XML_TAG_ATTRIBUTES], "multi")) {
     result += ({ parse_boolean(xml[XML_TAG_ATTRIBUTES]["multi"]) });
@@ -623,8 +943,192 @@ mixed *parse_syntax_xml(string specfile, mixed *xml, mapping field_map,
     }
   }
 
-  return ({ explode_args, min_args, max_args, pattern, format, 
-            args, opts, longopts, validation, subcommands });
+  return compile_syntax(specfile, ({ explode_args, min_args, max_args, 
+                                     pattern, format, args, opts, longopts, 
+                                     validation, subcommands }));
+}
+
+/**
+ * Compile a parsed syntax into the form used when applying it to a command
+ * line, so that none of this needs to be worked out per command. Appends 
+ * lookup mappings for opts and longopts, the resolved bounds on the number 
+ * of arguments, the parse strategy for the syntax format, a signature of 
+ * the valid opts which lets syntaxes share a single parse of them, and the 
+ * parser closure for pattern based formats.
+ * 
+ * @param  specfile        the spec filename
+ * @param  syntax          the parsed syntax
+ * @return the compiled syntax
+ */
+mixed *compile_syntax(string specfile, mixed *syntax) {
+  mapping valid_opts = ([ ]);
+  foreach (mixed *opt : syntax[SYNTAX_OPTS]) {
+    if (stringp(opt[OPT_OPT]) && strlen(opt[OPT_OPT])) {
+      valid_opts[opt[OPT_OPT][0]] = opt;
+    }
+  }
+
+  mapping valid_longopts = ([ ]);
+  foreach (mixed *opt : syntax[SYNTAX_LONGOPTS]) {
+    if (stringp(opt[OPT_OPT]) && strlen(opt[OPT_OPT])) {
+      valid_longopts[opt[OPT_OPT]] = opt;
+    }
+  }
+
+  // syntaxes with the same signature parse the opts section identically
+  string signature = "";
+  foreach (int opt : sort_array(m_indices(valid_opts), #'>)) { //'
+    signature += sprintf("%c%s", opt, valid_opts[opt][OPT_PARAM] ? ":" : "");
+  }
+  foreach (string opt : sort_array(m_indices(valid_longopts), #'>)) { //'
+    signature += sprintf(" %s%s", opt, 
+                         valid_longopts[opt][OPT_PARAM] ? "=" : "");
+  }
+
+  int min_numargs, max_numargs;
+  if (syntax[SYNTAX_EXPLODE_ARGS] >= 0) {
+    min_numargs = syntax[SYNTAX_EXPLODE_ARGS];
+    max_numargs = syntax[SYNTAX_EXPLODE_ARGS];
+  } else {
+    min_numargs = max(syntax[SYNTAX_MIN_ARGS], 0);
+    max_numargs = syntax[SYNTAX_MAX_ARGS];
+  }
+
+  int strategy;
+  switch (syntax[SYNTAX_FORMAT]) {
+    case "sscanf":
+      strategy = STRATEGY_SSCANF;
+      break;
+    case "regexp":
+      strategy = STRATEGY_REGEXP;
+      break;
+    case "parse_command":
+      strategy = STRATEGY_PARSE_COMMAND;
+      break;
+    case "explode":
+    default:
+      strategy = STRATEGY_EXPLODE;
+      break;
+  }
+
+  closure parser;
+  if (strategy != STRATEGY_EXPLODE) {
+    if (!stringp(syntax[SYNTAX_PATTERN])) {
+      parse_error(specfile, "missing attribute pattern");
+    }
+    parser = compile_parser(specfile, strategy, syntax[SYNTAX_PATTERN]);
+  }
+
+  return syntax + ({ valid_opts, valid_longopts, min_numargs, max_numargs, 
+                     strategy, signature, parser });
+}
+
+/**
+ * Generate the closure used to extract the argument list from a command line
+ * for a sscanf, regexp, or parse_command syntax. sscanf and parse_command 
+ * closures pass exactly as many lvalues as the pattern has conversions, and
+ * regexp patterns are validated up front so a bad pattern is reported when 
+ * the spec is loaded rather than when the command is used. The closure is 
+ * unbound; call it through bind_lambda() with the argument string.
+ * 
+ * @param  specfile        the spec filename
+ * @param  strategy        the parse strategy, see STRATEGY_* in command.h
+ * @param  pattern         the syntax pattern
+ * @return the parser closure, taking the argument string and returning the
+ *         array of matched arguments
+ */
+closure compile_parser(string specfile, int strategy, string pattern) {
+  switch (strategy) {
+    case STRATEGY_SSCANF:
+      int numargs = count_conversions(pattern, ({ '*' }));
+      if (numargs > MAX_ARGS) {
+        parse_error(specfile, "too many conversions in pattern " + pattern);
+      }
+      mixed *vars = allocate(numargs);
+      for (int i = 0; i < numargs; i++) {
+        vars[i] = quote("arg" + i);
+      }
+      return unbound_lambda(({ 'arg }), 
+        ({ #',, 
+           ({ #'=, 'matches, ({ #'sscanf, 'arg, pattern }) + vars }), 
+           ({ #'[..], 
+              ({ #'aggregate }) + vars, 
+              0, 
+              ({ #'-, 'matches, 1 }) 
+           }) 
+        })
+      ); //'
+
+    case STRATEGY_REGEXP:
+      if (catch(regexp(({ "" }), pattern); nolog)) {
+        parse_error(specfile, "invalid regexp pattern " + pattern);
+      }
+      return unbound_lambda(({ 'arg }), 
+        ({ #'?, 
+           ({ #'=, 
+              'matches, 
+              ({ #'regmatch, 'arg, pattern, RE_MATCH_SUBS }) 
+           }), 
+           ({ #'[..], 'matches, 1, ({ #'-, ({ #'sizeof, 'matches }), 1 }) }), 
+           quote(({ })) 
+        })
+      ); //'
+
+    case STRATEGY_PARSE_COMMAND:
+      int numargs = count_conversions(pattern, ({ }));
+      if (numargs > MAX_ARGS) {
+        parse_error(specfile, "too many conversions in pattern " + pattern);
+      }
+      mixed *vars = allocate(numargs);
+      mixed *unmatched = allocate(numargs);
+      for (int i = 0; i < numargs; i++) {
+        vars[i] = quote("arg" + i);
+        unmatched[i] = ({ #'=, vars[i], UNMATCHED_ARG }); //'
+      }
+      // arguments after the first unmatched conversion are dropped
+      return unbound_lambda(({ 'arg }), 
+        ({ #',, 
+           ({ #', }) + unmatched, 
+           ({ #'?, 
+              ({ #'parse_command, 'arg, quote(({ })), pattern }) + vars, 
+              ({ #',, 
+                 ({ #'=, 'args, ({ #'aggregate }) + vars }), 
+                 ({ #'=, 'i, ({ #'member, 'args, UNMATCHED_ARG }) }), 
+                 ({ #'?, 
+                    ({ #'<, 'i, 0 }), 
+                    'args, 
+                    ({ #'[..], 'args, 0, ({ #'-, 'i, 1 }) }) 
+                 }) 
+              }), 
+              quote(({ })) 
+           }) 
+        })
+      ); //'
+  }
+  return 0;
+}
+
+/**
+ * Count the conversions in a sscanf or parse_command pattern which assign
+ * to a variable.
+ * 
+ * @param  pattern         the pattern
+ * @param  suppress        modifier characters which suppress assignment of
+ *                         the conversion they precede
+ * @return the number of assigning conversions
+ */
+int count_conversions(string pattern, int *suppress) {
+  int result = 0;
+  int len = strlen(pattern);
+  for (int i = 0; i < len - 1; i++) {
+    if (pattern[i] == '%') {
+      i++;
+      if ((pattern[i] != '%') && (member(suppress, pattern[i]) == -1)) {
+        result++;
+      }
+    }
+  }
+  return result;
 }
 
 /**
@@ -632,11 +1136,9 @@ mixed *parse_syntax_xml(string specfile, mixed *xml, mapping field_map,
  * 
  * @param  specfile        the spec filename
  * @param  xml             the deserialized xml to parse
- * @param  imports         a mapping of imported specfiles to imported
- *                         commands, passed by reference
- * @return the imported command
+ * @return the import, less its index; see IMPORT_* in command_spec.h
  */
-mixed *parse_import_xml(string specfile, mixed *xml, mapping imports) {
+mixed *parse_import_xml(string specfile, mixed *xml) {
   xml[XML_TAG_ATTRIBUTES] ||= ([ ]);
   string id;
   if (member(xml[XML_TAG_ATTRIBUTES], "id")) {
@@ -657,16 +1159,35 @@ mixed *parse_import_xml(string specfile, mixed *xml, mapping imports) {
     parse_error(specfile, "missing attribute primaryVerb");
   }
 
+  return ({ id, spec, primary_verb });
+}
+
+/**
+ * Resolve an import to the command it refers to.
+ * 
+ * @param  specfile        the spec filename
+ * @param  import          the import; see IMPORT_* in command_spec.h
+ * @param  imports         a mapping of imported specfiles to imported
+ *                         commands, passed by reference
+ * @param  lazy            1 to import the indexed command rather than the 
+ *                         full one
+ * @return the imported command, or 0 if the imported spec has no command 
+ *         with the requested primary verb
+ */
+varargs mixed *resolve_import(string specfile, mixed *import, 
+                              mapping imports, int lazy) {
+  string spec = import[IMPORT_SPEC];
   mixed *commands = imports[spec];
   if (!commands) {
-    commands = load_command_spec(expand_path(spec, specfile));
+    string path = expand_path(spec, specfile);
+    commands = (lazy ? load_command_index(path) : load_command_spec(path));
     imports[spec] = commands;
   }
   foreach (mixed *command : commands) {
     if (sizeof(command[COMMAND_VERBS]) 
-        && (primary_verb == command[COMMAND_VERBS][0])) {
-      command = deep_copy(command);
-      command[COMMAND_ID] = id;
+        && (import[IMPORT_PRIMARY_VERB] == command[COMMAND_VERBS][0])) {
+      command = (lazy ? (command + ({ })) : deep_copy(command));
+      command[COMMAND_ID] = import[IMPORT_ID];
       command[COMMAND_CONTROLLER] = 
         expand_path(command[COMMAND_CONTROLLER], spec);
       return command;
@@ -686,6 +1207,54 @@ int parse_boolean(string value) {
   return (lower_case(value) == TRUE_VALUE);
 }
 
+/**
+ * Resolve the parser attribute of a command tag to the program path of its
+ * generated parser, see CommandParserLib.
+ * 
+ * @param  specfile      the spec filename
+ * @param  parser        the parser attribute, relative to the spec file
+ * @return the absolute program path, without the .c extension, or 0 if the
+ *         command doesn't use a generated parser
+ */
+string parse_parser_path(string specfile, string parser) {
+  if (!stringp(parser) || !strlen(parser)) {
+    return 0;
+  }
+  string result = expand_path(parser, specfile);
+  if (result[<2..] == ".c") {
+    result = result[0..<3];
+  }
+  return result;
+}
+
+/**
+ * Read the execution budget of a command from the evalBudget, arrayBudget,
+ * mappingBudget, and byteBudget attributes of its command tag.
+ * 
+ * @param  specfile      the spec filename
+ * @param  attributes    the command tag attributes
+ * @return the budget; see BUDGET_* in command.h, or 0 if none of the 
+ *         attributes were given
+ */
+int *parse_budget(string specfile, mapping attributes) {
+  int *result = allocate(BUDGET_SIZE);
+  int found = 0;
+  foreach (string attribute, int index : ([ "evalBudget" : BUDGET_EVAL, 
+                                            "arrayBudget" : BUDGET_ARRAY,
+                                            "mappingBudget" : BUDGET_MAPPING,
+                                            "byteBudget" : BUDGET_BYTE ])) {
+    if (member(attributes, attribute)) {
+      result[index] = to_int(attributes[attribute]);
+      if (result[index] <= 0) {
+        parse_error(specfile, "invalid " + attribute + " " 
+                              + attributes[attribute]);
+      }
+      found = 1;
+    }
+  }
+  return (found ? result : 0);
+}
+
 /**
  * Called during a parsing error.
  * 
@@ -14,4 +14,8 @@ struct DomainConfig {
   string root;
   closure allow_read;
   closure allow_write;
+  // ([ str user_class : ({ float rate, int burst, int queue }) ])
+  mapping rate_limits;
+  // default execution budget for commands, see BUDGET_* in command.h
+  int *command_budget;
 };
@@ -6,14 +6,20 @@
  */
 #pragma no_clone
 #include <expand_object.h>
+#include <logger.h>
 
 private inherit ArrayLib;
 private inherit ArgumentLib;
 private inherit FileLib;
 private inherit StringLib;
 
+LOGGER_HANDLE
+
 protected varargs mixed *expand_objects(mixed ospecs, object who,
                                         string root_context, int flags);
+protected varargs mapping expand_object_batch(string *ospecs, object who,
+                                              string root_context, 
+                                              int flags);
 private mixed *expand_group(string ospec, object who, string context,
                             string root_context, string *new_context,
                             int flags, mapping ancestors);
@@ -58,8 +64,7 @@ private object find_room(object arg);
  */
 protected varargs mixed *expand_objects(mixed ospecs, object who,
                                         string root_context, int flags) {
-  object logger = LoggerFactory->get_logger(THISO);
-  logger->trace("expand_objects(%O)", ospecs);
+  LOG_TRACE(("expand_objects(%O)", ospecs));
   string current_context = "";
   if (who) {
     current_context = who->query_context() || "";
@@ -101,6 +106,51 @@ protected varargs mixed *expand_objects(mixed ospecs, object who,
   }
 }
 
+/**
+ * Expand several independent object specifiers in one pass, such as the
+ * values of different command fields. Each specifier is expanded as if it
+ * were passed to expand_objects() on its own, but the contexts looked up
+ * along the way are shared between them, so each context is only walked 
+ * once. UPDATE_CONTEXT isn't supported, since the specifiers don't make a
+ * single selection.
+ *
+ * @param  ospecs       the ospecs to expand
+ * @param  who          the context in which to perform the expansion
+ * @param  root_context an optional object ospec which will be used if no
+ *                      objects can be found for 'who'
+ * @param  flags        control flags
+ * @return              a mapping of each ospec to its array of target 
+ *                      objects (see expand_objects())
+ */
+protected varargs mapping expand_object_batch(string *ospecs, object who,
+                                              string root_context, 
+                                              int flags) {
+  string current_context = "";
+  if (who) {
+    current_context = who->query_context() || "";
+  }
+  if (!stringp(root_context)) {
+    root_context = "";
+  }
+  flags &= ~UPDATE_CONTEXT;
+
+  mapping result = ([ ]);
+  mapping ancestors = ([ ]);
+  string *new_context = ({ });
+  foreach (string ospec : ospecs) {
+    if (!stringp(ospec) || member(result, ospec)) {
+      continue;
+    }
+    mixed *targets = expand_group(ospec, who, current_context, root_context,
+                                  &new_context, flags, ancestors);
+    if (sizeof(targets) && (flags & LIMIT_ONE)) {
+      targets = targets[0..0];
+    }
+    result[ospec] = targets;
+  }
+  return result;
+}
+
 /**
  * Process the individual ospecs from the list passed to expand_objects().
  * This function is processes grouped ospecs, splitting them up and sending
@@ -125,11 +175,10 @@ protected varargs mixed *expand_objects(mixed ospecs, object who,
 private mixed *expand_group(string ospec, object who, string context,
                             string root_context, string *new_context,
                             int flags, mapping ancestors) {
-  object logger = LoggerFactory->get_logger(THISO);
-  logger->trace("expand_group, context = %O", context);
+  LOG_TRACE(("expand_group, context = %O", context));
   string *subspecs = explode_nested(ospec, SPEC_DELIM,
                                     OPEN_GROUP, CLOSE_GROUP);
-  logger->trace("expand_group(%O) => %O", ospec, subspecs);
+  LOG_TRACE(("expand_group(%O) => %O", ospec, subspecs));
 
   if (sizeof(subspecs) == 1) {
     mixed *result;
@@ -140,7 +189,7 @@ private mixed *expand_group(string ospec, object who, string context,
       // found matching object in this context
       if (sizeof(result)) {
         new_context += ({ ctx });
-        logger->trace("expand_group context = %O", ctx);
+        LOG_TRACE(("expand_group context = %O", ctx));
         break;
       }
       int pos = searcha(context, CONTEXT_DELIM[0], sizeof(context) - 1, -1);
@@ -199,10 +248,9 @@ private mixed *expand_group(string ospec, object who, string context,
 private string expand_spec(string ospec, object who, string context,
                            string *new_context, int flags,
                            mapping ancestors) {
-  object logger = LoggerFactory->get_logger(THISO);
   string *args = explode_nested(ospec, CONTEXT_DELIM,
                                 OPEN_GROUP, CLOSE_GROUP);
-  logger->trace("expand_spec(%O) => %O", ospec, args);
+  LOG_TRACE(("expand_spec(%O) => %O", ospec, args));
   foreach (string arg : args) {
     context = expand_single(arg, who, context, &new_context, flags,
                             ancestors);
@@ -231,7 +279,6 @@ private string expand_spec(string ospec, object who, string context,
 private string expand_single(string arg, object who, string context,
                              string *new_context, int flags,
                              mapping ancestors) {
-  object logger = LoggerFactory->get_logger(THISO);
   string resolved = resolve_spec(arg, context);
   if (member(ancestors, resolved)) {
     return resolved;
@@ -322,7 +369,6 @@ private string expand_single(string arg, object who, string context,
  */
 private mixed *expand_term(string term, mixed *prev, object who,
                            string context, int flags) {
-  object logger = LoggerFactory->get_logger(THISO);
   term = unescape(term);
   switch (term) {
   case "users":
@@ -376,9 +422,9 @@ private mixed *expand_term(string term, mixed *prev, object who,
     }
   default:
     // first look for matching ids
-    logger->trace("term = %O, prev = %O", term, prev);
+    LOG_TRACE(("term = %O, prev = %O", term, prev));
     mixed *id_matches = map(prev, #'expand_id, term); //'
-    logger->trace("id_matches = %O", id_matches);
+    LOG_TRACE(("id_matches = %O", id_matches));
     id_matches -= ({ 0 });
     if (sizeof(id_matches)) {
       prev = id_matches;
@@ -413,7 +459,7 @@ private mixed *expand_term(string term, mixed *prev, object who,
         if (!sizeof(files)) {
           files = expand_pattern(term + ".c", who);
         }
-        logger->trace("files = %O\n", files);
+        LOG_TRACE(("files = %O\n", files));
         foreach (mixed *f : files) {
           string file = f[0];
           if (!is_loadable(file)) {
@@ -435,7 +481,7 @@ private mixed *expand_term(string term, mixed *prev, object who,
           }
         }
       }
-      logger->trace("context = %O, matches = %O\n", context, matches);
+      LOG_TRACE(("context = %O, matches = %O\n", context, matches));
       if (!strlen(context)) {
         return map(matches, (: ({ $1, term, 0 }) :));
       } else {
@@ -458,8 +504,7 @@ private mixed *expand_term(string term, mixed *prev, object who,
  * @return    a new target object with id/detail id expanded
  */
 private mixed *expand_id(mixed *in, string id) {
-  object logger = LoggerFactory->get_logger(THISO);
-  logger->trace("expand_id, id= %O, in = %O", id, in);
+  LOG_TRACE(("expand_id, id= %O, in = %O", id, in));
   if (in[OB_DETAIL]) {
     if (in[OB_TARGET]->query_detail(id, in[OB_DETAIL])) {
       return ({ in[OB_TARGET], in[OB_ID], resolve_spec(id, in[OB_DETAIL]) });
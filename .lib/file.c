@@ -6,21 +6,26 @@
  */
 #pragma no_clone
 #include <sys/files.h>
+#include <logger.h>
 
 // TODO need to clean up old patterns periodically
 // TODO externalize caching
 // ([ pattern : time; result ])
 private nosave mapping pattern_cache = ([ ]);
 
+LOGGER_HANDLE
+
 protected int file_exists(string filename);
 protected int is_directory(string filename);
 protected string basename(string filename);
 protected string dirname(string filename);
 protected string munge_filename(string filename);
 protected varargs string expand_path(string pattern, mixed rel);
-protected varargs mixed *expand_pattern(string pattern, object rel);
-private mixed *expand_files(string *path, mixed *dirs);
-private mixed *collate_files(string dir, string pattern);
+protected varargs mixed *expand_pattern(string pattern, object rel, 
+                                        mapping listings);
+protected varargs mapping expand_patterns(string *patterns, object rel);
+private mixed *expand_files(string *path, mixed *dirs, mapping listings);
+private mixed *collate_files(string dir, string pattern, mapping listings);
 protected int is_loadable(string file);
 protected int is_special_dir(string path);
 private int _traverse(closure callback, mixed *info, string root, 
@@ -188,12 +193,15 @@ protected varargs string expand_path(string pattern, mixed rel) {
  * in the middle of the path will be expanded in place (e.g.
  * "home/*&#47;workroom.c" expands to all workroom files).
  *
- * @param  pattern the file pattern to expand
- * @param  rel     optional path or object from which relative paths should be
- *                 resolved
- * @return         a list of all matching files (constrained by valid_read)
+ * @param  pattern  the file pattern to expand
+ * @param  rel      optional path or object from which relative paths should
+ *                  be resolved
+ * @param  listings optional mapping of directory listings to reuse, see
+ *                  expand_patterns()
+ * @return          a list of all matching files (constrained by valid_read)
  */
-protected varargs mixed *expand_pattern(string pattern, object rel) {
+protected varargs mixed *expand_pattern(string pattern, object rel, 
+                                        mapping listings) {
   pattern = expand_path(pattern, rel);
   if (pattern[<1] == '/') {
     pattern += "*";
@@ -206,29 +214,52 @@ protected varargs mixed *expand_pattern(string pattern, object rel) {
   }
 
   mixed *result = expand_files(explode(pattern, "/")[1..],
-                               ({ ({ 0, "", 0, 0, 0 }) }));
+                               ({ ({ 0, "", 0, 0, 0 }) }), listings);
   pattern_cache += ([ pattern : time(); result ]);
   return result;
 }
 
+/**
+ * Resolve several file patterns in one pass. Directory listings are shared
+ * between the patterns, so patterns which walk the same directories only 
+ * list them once.
+ *
+ * @param  patterns the file patterns to expand
+ * @param  rel      optional path or object from which relative paths should
+ *                  be resolved
+ * @return          a mapping of each pattern to its list of matching files
+ *                  (see expand_pattern())
+ */
+protected varargs mapping expand_patterns(string *patterns, object rel) {
+  mapping result = ([ ]);
+  mapping listings = ([ ]);
+  foreach (string pattern : patterns) {
+    if (!member(result, pattern)) {
+      result[pattern] = expand_pattern(pattern, rel, listings);
+    }
+  }
+  return result;
+}
+
 /**
  * Recursive function to resolve wildcards in the middle of a path.
  *
- * @param  path the path to resolve, split by '/'
- * @param  dirs a running array of directories to inspect for matching files
- * @return      the list of all matching files
+ * @param  path     the path to resolve, split by '/'
+ * @param  dirs     a running array of directories to inspect for matching 
+ *                  files
+ * @param  listings a mapping of directory listings to reuse, or 0
+ * @return          the list of all matching files
  */
-private mixed *expand_files(string *path, mixed *dirs) {
+private mixed *expand_files(string *path, mixed *dirs, mapping listings) {
   // FUTURE add '**' support
   mixed *result = ({ });
   string pattern = "/" + path[0];
 
-  object logger = LoggerFactory->get_logger(THISO);
-  logger->trace("pattern: %O", pattern);
-  logger->trace("path: %O", path);
+  LOG_TRACE(("pattern: %O", pattern));
+  LOG_TRACE(("path: %O", path));
   if (sizeof(path) > 1) {
     foreach (mixed *dir : dirs) {
-      mixed *alist = collate_files(dir[1], pattern);
+      mixed *alist = collate_files(dir[1], pattern, listings);
       if (!alist) { continue; }
       alist = order_alist(alist[1], alist[0], alist[2], alist[3], alist[4]);
       int dir_index = rmember(alist[0], FSIZE_DIR);
@@ -239,15 +270,15 @@ private mixed *expand_files(string *path, mixed *dirs) {
       alist[4] = alist[4][0..dir_index];
       result += transpose_array(alist);
     }
-    logger->trace("result: %O", result);
-    return expand_files(path[1..], result);
+    LOG_TRACE(("result: %O", result));
+    return expand_files(path[1..], result, listings);
   } else {
     foreach (mixed *dir : dirs) {
-      mixed *alist = collate_files(dir[1], pattern);
+      mixed *alist = collate_files(dir[1], pattern, listings);
       if (!alist) { continue; }
       result += transpose_array(alist);
     }
-    logger->trace("result: %O", result);
+    LOG_TRACE(("result: %O", result));
     return result;
   }
 }
@@ -259,19 +290,29 @@ private mixed *expand_files(string *path, mixed *dirs) {
  * ({ names, sizes, modified_dates, accessed_dates, modes })
  * </code></pre>
  *
- * @param  dir     the parent directory of the files being collated
- * @param  pattern the file pattern, may contain wildcards
- * @return         an alist of the target directory's contents
+ * @param  dir      the parent directory of the files being collated
+ * @param  pattern  the file pattern, may contain wildcards
+ * @param  listings a mapping of directory listings to reuse, or 0; the alist
+ *                  is added to it
+ * @return          an alist of the target directory's contents
  */
-private mixed *collate_files(string dir, string pattern) {
-  object logger = LoggerFactory->get_logger(THISO);
-  logger->trace("dir: %O", dir);
-  logger->trace("pattern: %O", pattern);
+private mixed *collate_files(string dir, string pattern, mapping listings) {
+  if (listings && member(listings, dir + pattern)) {
+    return listings[dir + pattern];
+  }
+
+  LOG_TRACE(("dir: %O", dir));
+  LOG_TRACE(("pattern: %O", pattern));
   mixed *contents = get_dir(dir + pattern, GETDIR_ALL
                                           |GETDIR_PATH
                                           |GETDIR_UNSORTED);
   int size = sizeof(contents);
-  if (!size) { return 0; }
+  if (!size) {
+    if (listings) {
+      listings[dir + pattern] = 0;
+    }
+    return 0;
+  }
 
   int step = 5;
   mixed *names = allocate((size / step));
@@ -300,7 +341,11 @@ private mixed *collate_files(string dir, string pattern) {
   modified[pos..] = ({ });
   accessed[pos..] = ({ });
   modes[pos..] = ({ });
-  return ({ names, sizes, modified, accessed, modes });
+  mixed *result = ({ names, sizes, modified, accessed, modes });
+  if (listings) {
+    listings[dir + pattern] = result;
+  }
+  return result;
 }
 
 /**
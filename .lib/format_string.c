@@ -13,7 +13,8 @@ private inherit ArrayLib;
 private inherit StringLib;
 private inherit ClosureLib;
 
-protected closure parse_format(string format, mapping infomap, symbol *args);
+protected varargs closure parse_format(string format, mapping infomap, 
+                                       symbol *args, mapping specs);
 protected varargs string *explode_format(string str, string delim,
                                          string open, string close);
 /**
@@ -55,10 +56,14 @@ protected varargs string *explode_format(string str, string delim,
  *                 replace the specifier
  * @param  args    optional args that will be passed to the formatter
  *                 (single quoted)
+ * @param  specs   optional mapping in which to record the format specifiers
+ *                 used by the format string, and their args, as
+ *                 <code>([ int spec : ({ string arg, ... }) ])</code>
  * @return         a formatter closure that takes specified args and will
  *                 produce formatted strings according to infomap
  */
-protected closure parse_format(string format, mapping infomap, symbol *args) {
+protected varargs closure parse_format(string format, mapping infomap, 
+                                       symbol *args, mapping specs) {
   object logger = LoggerFactory->get_logger(THISO);
   string output_fmt = "";
   mixed *output_args = ({ });
@@ -89,6 +94,9 @@ protected closure parse_format(string format, mapping infomap, symbol *args) {
         logger->warn("Unmatched '%c': %%%s", part[1], part);
       }
     }
+    if (specs) {
+      specs[spec] = (specs[spec] || ({ })) + ({ arg });
+    }
 
     output_fmt = sprintf("%s%s%s", output_fmt, info[SPRINTF_FMT], extra);
     output_args += funcall(
@@ -9,9 +9,12 @@
  * @alias CommandController
  */
 #pragma no_clone
+#include <sys/debug_info.h>
+#include <sys/rtlimits.h>
 #include <sys/strings.h>
 #include <command.h>
 #include <command_controller.h>
+#include <metrics.h>
 #include <prompt.h>
 
 private inherit CommandLib;
@@ -34,38 +37,85 @@ struct CommandState {
   mapping model;
   int field_retry;
   int form_retry;
-  int force_prompt;
+  mapping stale;
+  mapping piped;
+  int stage;
+  mapping expanded_files;
+  mapping expanded_objects;
+  int prompting;
+  int ticks;
+  int usec;
 };
 
 closure prompt_formatter, fail_formatter;
+// ([ str specfile : ([ mixed *validation : closure validator ]) ])
+private nosave mapping validators = ([ ]);
+// ([ str key : ({ mapping result, mixed *messages, str *paths }) ])
+private nosave mapping result_cache = ([ ]);
+// ([ str path : ([ str key, ... ]) ])
+private nosave mapping cached_paths = ([ ]);
+// whether cache_signal() is subscribed to the FileTracker
+private nosave int watching_cache;
+// ({ obj tracker, int config_version, int *budget }), the domain default
+// budget, see query_budget()
+private nosave mixed *domain_budget;
+// messages sent to this player while a cacheable command runs, or 0
+private nosave mixed *captured;
+// the evaluation the messages are captured in, so that captures left over
+// from a command which raised an error are ignored
+private nosave int capture_eval;
 
 public void setup();
 public void teardown();
-public mapping do_command(mixed *command, string verb, string arg);
+public varargs mapping do_command(mixed *command, string verb, string arg,
+                                  mapping pipe);
+mapping pipe_model(mixed *command, mixed *syntax, mapping opts, string *args,
+                   mapping pipe);
+int count_piped_args(mixed *syntax, string *args, mapping model);
+mapping run_command(struct CommandState state, closure callback);
 mapping process_command(struct CommandState state, closure callback);
 int process_args(struct CommandState state, closure callback);
 int process_opts(struct CommandState state, mapping opts, closure callback);
 int process_extra(struct CommandState state, closure callback);
+int prompt_stale(struct CommandState state, mixed *field, string field_type, 
+                 mixed index, closure callback);
 int process_field(struct CommandState state, mixed *field, string field_type, 
                   mixed index, closure callback);
 void field_prompt(struct CommandState state, mixed *field, string field_type, 
                   mixed index, closure callback);
 public int field_input(string arg, struct CommandState state, mixed *field, 
                        string field_type, mixed index, closure callback);
+void expand_fields(struct CommandState state);
+string field_arg(struct CommandState state, mixed *field, string field_type, 
+                 mixed index);
 string parse_value(struct CommandState state, mixed *field, string field_type, 
                    mixed index, mixed val);
 string parse_boolean(string arg, mixed val);
 string parse_int(string arg, mixed val);
 string parse_float(string arg, mixed val);
 string parse_enum(string arg, mixed val, mixed *enum);
-string parse_file(string arg, mixed val);
-string parse_files(string arg, mixed val);
-string parse_object(string arg, mixed val);
-string parse_objects(string arg, mixed val);
+string parse_file(string arg, mixed val, mapping expanded);
+string parse_files(string arg, mixed val, mapping expanded);
+string parse_object(string arg, mixed val, mapping expanded);
+string parse_objects(string arg, mixed val, mapping expanded);
 varargs int do_validate(struct CommandState state, closure callback, 
                         int flags);
+int retry_form(struct CommandState state, closure callback);
 int validate(mixed *validations, struct CommandState state, mixed val, 
              mixed *field, closure retry_test);
+closure compile_validator(mixed *validation);
+public void release_spec(string specfile);
+mapping execute_command(struct CommandState state, closure callback);
+string cache_key(struct CommandState state);
+void cache_result(string key, struct CommandState state, mapping result,
+                  mixed *messages);
+public void cache_signal(string file, string func);
+mapping run_limited(struct CommandState state, closure callback);
+int *query_budget(mixed *command);
+protected varargs struct Message stdout_msg(string message, mapping context,
+                                            object ob, string topic);
+protected varargs struct Message stderr_msg(string message, mapping context,
+                                            object ob, string topic);
 mapping do_execute(mapping model, string verb);
 public mapping execute(mapping model, string verb);
 
@@ -117,21 +167,43 @@ public void teardown() {
  * command in the future after execute() finishes, if it is desirable to do so
  * by the user.
  *
- * TODO implement command piping
+ * When run as part of a pipeline, the output model of the previous command 
+ * is passed as the pipe mapping. Values for any of this command's fields are
+ * taken from it directly, without being rendered or parsed again, unless the
+ * field was also given explicitly on the command line.
+ *
+ * Commands with a generated parser program have their syntax applied by it
+ * instead of by apply_syntax(), see CommandParserLib.
  * 
  * @param  command       the command info as loaded from the command spec
  * @param  verb          the verb being used
  * @param  arg           the argument string
+ * @param  pipe          the output model of the previous command in the 
+ *                       pipeline, if any
  * @return an "output" model mapping, or 0 if either the command failed or an
  *         interactive prompt was issued
  */
-public mapping do_command(mixed *command, string verb, string arg) {
+public varargs mapping do_command(mixed *command, string verb, string arg,
+                                  mapping pipe) {
   mapping opts, badopts;
   string *args;
   arg = trim(arg, TRIM_RIGHT, ' ');
-  mixed *syntax = apply_syntax(command, arg, &opts, &badopts, &args);
+  mixed *syntax;
+  object parser = CommandSpecTracker->query_parser(command);
+  if (parser) {
+    // generated from the spec, see CommandParserLib
+    mixed *parsed = parser->parse_syntax(arg);
+    syntax = command[COMMAND_SYNTAX][parsed[GENERATED_SYNTAX]];
+    opts = parsed[GENERATED_OPTS];
+    badopts = parsed[GENERATED_BADOPTS];
+    args = parsed[GENERATED_ARGS];
+  } else {
+    syntax = apply_syntax(command, arg, &opts, &badopts, &args);
+  }
+  mapping model = pipe_model(command, syntax, opts, args, pipe);
 
-  if (valid_syntax(syntax, opts, badopts, args)) {
+  if (valid_syntax(syntax, opts, badopts, 
+                   args + allocate(count_piped_args(syntax, args, model)))) {
     struct CommandState state = 
       (<CommandState> 
         verb: verb, 
@@ -140,23 +212,117 @@ public mapping do_command(mixed *command, string verb, string arg) {
         opts: opts, 
         args: args, 
         extra: ([ ]), 
-        model: ([ ]), 
+        model: model, 
         field_retry: 0, 
         form_retry: 0, 
-        force_prompt: 0);
-    return process_command(state, symbol_function("do_execute", THISO)); //'
+        stale: ([ ]), 
+        piped: mkmapping(m_indices(model)), 
+        stage: STAGE_ARGS, 
+        expanded_files: 0, 
+        expanded_objects: 0,
+        prompting: 0,
+        ticks: 0,
+        usec: 0);
+    return run_command(state, symbol_function("do_execute", THISO)); //'
   } 
 
   // fail syntax
   return 0;
 }
 
+/**
+ * Build the initial field model from the output model of a previous command
+ * in the pipeline. Only values for fields defined by this command are kept,
+ * and fields which were given explicitly as args or opts take precedence
+ * over piped values.
+ * 
+ * @param  command       the command info as loaded from the command spec
+ * @param  syntax        the syntax being applied
+ * @param  opts          the parsed opts and longopts
+ * @param  args          the parsed argument list
+ * @param  pipe          the output model of the previous command, or 0
+ * @return the initial field model
+ */
+mapping pipe_model(mixed *command, mixed *syntax, mapping opts, string *args,
+                   mapping pipe) {
+  mapping result = ([ ]);
+  if (!pipe) {
+    return result;
+  }
+  foreach (mixed *field : command[COMMAND_FIELDS]) {
+    if (member(pipe, field[FIELD_ID])) {
+      result[field[FIELD_ID]] = pipe[field[FIELD_ID]];
+    }
+  }
+
+  int numargs = min(sizeof(args), sizeof(syntax[SYNTAX_ARGS]));
+  for (int i = 0; i < numargs; i++) {
+    m_delete(result, syntax[SYNTAX_ARGS][i][FIELD_ID]);
+  }
+  foreach (mixed opt, mixed *field : syntax[SYNTAX_VALID_OPTS] 
+                                     + syntax[SYNTAX_VALID_LONGOPTS]) {
+    if (member(opts, opt)) {
+      m_delete(result, field[FIELD_ID]);
+    }
+  }
+  return result;
+}
+
+/**
+ * Count the syntax args which weren't given on the command line but whose 
+ * values were supplied by a pipe, so that they count towards the argument 
+ * bounds of the syntax.
+ * 
+ * @param  syntax        the syntax being applied
+ * @param  args          the parsed argument list
+ * @param  model         the initial field model
+ * @return the number of args supplied by the pipe
+ */
+int count_piped_args(mixed *syntax, string *args, mapping model) {
+  int result = 0;
+  int numfields = sizeof(syntax[SYNTAX_ARGS]);
+  for (int i = sizeof(args); i < numfields; i++) {
+    if (member(model, syntax[SYNTAX_ARGS][i][FIELD_ID])) {
+      result++;
+    }
+  }
+  return result;
+}
+
+/**
+ * Run the command processor from the top. The eval ticks and time spent are
+ * added up across each time processing resumes after a prompt, and recorded
+ * against this controller in the MetricsService once the command is no 
+ * longer waiting on one. Time spent waiting for input isn't counted.
+ * 
+ * @param  state         the command state
+ * @param  callback      the callback to execute the validated command
+ * @return the result of process_command()
+ */
+mapping run_command(struct CommandState state, closure callback) {
+  int ticks = get_eval_cost();
+  int *start = utime();
+  mapping result = process_command(state, callback);
+  int *end = utime();
+  state->ticks += ticks - get_eval_cost();
+  state->usec += ((end[0] - start[0]) * 1000000) + (end[1] - start[1]);
+  if (!state->prompting) {
+    MetricsService->record(METRIC_CONTROLLER, object_name(THISO), 
+                           state->ticks, state->usec);
+  }
+  return result;
+}
+
 /**
  * Entry-point into command processor. Anytime the command state changes, this
  * function may be called which attempts to run the command. If there is still
  * missing or invalid input, it will descend into sub-processing functions to
  * correct the problem, and re-run process_command() with the new command 
  * state. If the command state is good, the callback will be executed.
+ *
+ * Processing resumes from the stage it last stopped at, and fields already in
+ * the model are kept, so only fields which were changed by prompted input are
+ * parsed and validated again.
  * 
  * @param  state         the command state, a struct containing all the 
  *                       information about the command-to-be-executed we have
@@ -166,23 +332,37 @@ public mapping do_command(mixed *command, string verb, string arg) {
  *         input
  */
 mapping process_command(struct CommandState state, closure callback) {
-  if (!process_args(state, callback)) {
-    return 0;
-  }
-  if (!process_opts(state, state->syntax[SYNTAX_OPTS], callback)) {
-    return 0;
+  if (!state->expanded_files) {
+    expand_fields(state);
   }
-  if (!process_opts(state, state->syntax[SYNTAX_LONGOPTS], callback)) {
-    return 0;
-  }
-  if (!process_extra(state, callback)) {
-    return 0;
-  }
-  if (!do_validate(state, callback, VALIDATE_SKIP_FIELDS)) {
-    return 0;
+  while (state->stage < STAGE_EXECUTE) {
+    int done;
+    switch (state->stage) {
+      case STAGE_ARGS:
+        done = process_args(state, callback);
+        break;
+      case STAGE_OPTS:
+        done = process_opts(state, state->syntax[SYNTAX_VALID_OPTS], 
+                            callback);
+        break;
+      case STAGE_LONGOPTS:
+        done = process_opts(state, state->syntax[SYNTAX_VALID_LONGOPTS], 
+                            callback);
+        break;
+      case STAGE_EXTRA:
+        done = process_extra(state, callback);
+        break;
+      case STAGE_VALIDATE:
+        done = do_validate(state, callback, VALIDATE_SKIP_FIELDS);
+        break;
+    }
+    if (!done) {
+      return 0;
+    }
+    state->stage++;
   }
 
-  return funcall(callback, state->model, state->verb);
+  return execute_command(state, callback);
 }
 
 /**
@@ -202,19 +382,26 @@ int process_args(struct CommandState state, closure callback) {
   int i = 0;
   int numargs = sizeof(state->args);
   foreach (mixed *field : state->syntax[SYNTAX_ARGS]) {
-    if (!member(state->model, field[FIELD_ID])) {
-      if ((i < numargs) && !state->force_prompt) {
+    if (member(state->stale, field[FIELD_ID])) {
+      if (i >= sizeof(state->args)) {
+        state->args += allocate(i + 1 - sizeof(state->args));
+      }
+      return prompt_stale(state, field, "args", i, callback);
+    } else if (!member(state->model, field[FIELD_ID])) {
+      if (i < numargs) {
         // we have the arg, process it
         if (!process_field(state, field, "args", i, callback)) {
           return 0;
         }
       } else {
-        state->force_prompt = 0;
         // not enough args provided
         if ((field[FIELD_PROMPT_SETTING] == PROMPT_SYNTAX)
             || (field[FIELD_PROMPT_SETTING] == PROMPT_ALWAYS)) {
           // prompt user for value
-          state->args += ({ field[FIELD_DEFAULT] });
+          if (i >= sizeof(state->args)) {
+            state->args += allocate(i - sizeof(state->args))
+                           + ({ field[FIELD_DEFAULT] });
+          }
           field_prompt(state, field, "args", i, callback);
           return 0;
         } else {
@@ -223,6 +410,9 @@ int process_args(struct CommandState state, closure callback) {
             return 0;            
           } else {
             // not required, continue with default
+            if (i >= sizeof(state->args)) {
+              state->args += allocate(i + 1 - sizeof(state->args));
+            }
             state->args[i] = field[FIELD_DEFAULT];
             if (!process_field(state, field, "args", i, callback)) {
               return 0;
@@ -246,20 +436,22 @@ int process_args(struct CommandState state, closure callback) {
  * @param  state         the command state, a struct containing all the 
  *                       information about the command-to-be-executed we have
  *                       so far
- * @param  opts          a map of opt or longopt string to the field definition
+ * @param  opts          a map of opt or longopt to the field definition, as 
+ *                       compiled into the syntax
  * @param  callback      the callback to execute the validated command
  * @return 1 to continue processing, otherwise 0
  */
 int process_opts(struct CommandState state, mapping opts, closure callback) {
   foreach (mixed opt, mixed *field : opts) {
-    if (!member(state->model, field[FIELD_ID])) {
-      if (member(opts, opt) && !state->force_prompt) {
+    if (member(state->stale, field[FIELD_ID])) {
+      return prompt_stale(state, field, "opts", opt, callback);
+    } else if (!member(state->model, field[FIELD_ID])) {
+      if (member(state->opts, opt)) {
         // we have the opt, process it
         if (!process_field(state, field, "opts", opt, callback)) {
           return 0;
         }
       } else {
-        state->force_prompt = 0;
         // opt not provided
         if ((field[FIELD_PROMPT_SETTING] == PROMPT_SYNTAX)
             || (field[FIELD_PROMPT_SETTING] == PROMPT_ALWAYS)) {
@@ -301,14 +493,15 @@ int process_opts(struct CommandState state, mapping opts, closure callback) {
 int process_extra(struct CommandState state, closure callback) {
   foreach (mixed *field : state->command[COMMAND_FIELDS]) {
     string id = field[FIELD_ID];
-    if (!member(state->model, id)) {
-      if (member(state->extra, id) && !state->force_prompt) {
+    if (member(state->stale, id)) {
+      return prompt_stale(state, field, "extra", id, callback);
+    } else if (!member(state->model, id)) {
+      if (member(state->extra, id)) {
         // we have the field, process it
         if (!process_field(state, field, "extra", id, callback)) {
           return 0;
         }
       } else {
-        state->force_prompt = 0;
         // field not provided
         if ((field[FIELD_PROMPT_SETTING] == PROMPT_SYNTAX)
             || (field[FIELD_PROMPT_SETTING] == PROMPT_ALWAYS)) {
@@ -334,6 +527,31 @@ int process_extra(struct CommandState state, closure callback) {
   return 1;
 }
 
+/**
+ * Prompt again for a field which was marked stale by a failed form 
+ * validation. The field keeps its value in the model until new input is 
+ * given for it, see field_input().
+ * 
+ * @param  state         the command state, a struct containing all the 
+ *                       information about the command-to-be-executed we have
+ *                       so far
+ * @param  field         the field info from the parsed command spec
+ * @param  field_type    field type: "args", "opts", or "extra"
+ * @param  index         field index, int for arg position, string for opts or
+ *                       extra field ids
+ * @param  callback      the callback to execute the validated command
+ * @return 0 to halt processing until input is given
+ */
+int prompt_stale(struct CommandState state, mixed *field, string field_type, 
+                 mixed index, closure callback) {
+  mapping values = get_struct_member(state, field_type);
+  if (mappingp(values) && !member(values, index)) {
+    m_add(values, index, field[FIELD_DEFAULT]);
+  }
+  field_prompt(state, field, field_type, index, callback);
+  return 0;
+}
+
 /**
  * Process a field. This function has 3 duties, parse the field value from the
  * input string, run field validations on the value, and add the value to the 
@@ -388,10 +606,6 @@ int process_field(struct CommandState state, mixed *field, string field_type,
     state->model[field[FIELD_ID]] = val;
     // reset retries to 0 fo next field
     state->field_retry = 0;
-    // if form retry, force prompt for next field
-    if (state->form_retry > 0) {
-      state->force_prompt = 1;
-    }
     return 1;
   }
 }
@@ -417,7 +631,11 @@ void field_prompt(struct CommandState state, mixed *field, string field_type,
     context[PROMPT_NO_ECHO] = 1;
   }
 
-  string val = get_struct_member(state, field_type)[index];
+  mixed val = get_struct_member(state, field_type)[index];
+  if (pointerp(val)) {
+    // parsed opts hold a param for each time they were given
+    val = (sizeof(val) ? val[<1] : 0);
+  }
   string prompt = funcall(
     prompt_formatter, 
     field[FIELD_PROMPT][PROMPT_MSG],
@@ -429,13 +647,15 @@ void field_prompt(struct CommandState state, mixed *field, string field_type,
     val
   );
 //  LoggerFactory->get_logger(THISO)->info("%O %O %O %O %O %O %O %O", THISP, prompt, context, state, field, field_type, index, callback);
+  state->prompting = 1;
   prompt(THISP, prompt, context, 
          #'field_input, state, field, field_type, index, callback);
 }
 
 /**
  * Handle field prompt input. This should update the command state with the
- * new value and re-run process_command().
+ * new value and re-run process_command(). Empty input keeps the current 
+ * value of the field.
  * 
  * @param  input         the input string
  * @param  state         the command state, a struct containing all the 
@@ -452,13 +672,101 @@ void field_prompt(struct CommandState state, mixed *field, string field_type,
  */
 public int field_input(string input, struct CommandState state, mixed *field, 
                        string field_type, mixed index, closure callback) {
+  state->prompting = 0;
+  m_delete(state->stale, field[FIELD_ID]);
   if (input && strlen(input)) {
     get_struct_member(state, field_type)[index] = input;
+    // only the changed field needs to be parsed and validated again
+    m_delete(state->model, field[FIELD_ID]);
+    // don't reuse expansions which may have gone stale while prompting
+    state->expanded_files = ([ ]);
+    state->expanded_objects = ([ ]);
   }
-  process_command(state, callback);
+  run_command(state, callback);
   return 0;
 }
 
+/**
+ * Expand the file patterns and object specifiers of every file and object
+ * field given on the command line in one batch, so that fields resolving 
+ * against the same directories or object contexts share the lookups. The
+ * results are kept in the command state for parse_value().
+ * 
+ * @param  state         the command state, a struct containing all the 
+ *                       information about the command-to-be-executed we have
+ *                       so far
+ */
+void expand_fields(struct CommandState state) {
+  // ({ ({ field, field_type, index }) })
+  mixed *given = ({ });
+  int numargs = min(sizeof(state->args), sizeof(state->syntax[SYNTAX_ARGS]));
+  for (int i = 0; i < numargs; i++) {
+    given += ({ ({ state->syntax[SYNTAX_ARGS][i], "args", i }) });
+  }
+  foreach (mixed opt, mixed *field : state->syntax[SYNTAX_VALID_OPTS]
+                                     + state->syntax[SYNTAX_VALID_LONGOPTS]) {
+    if (member(state->opts, opt)) {
+      given += ({ ({ field, "opts", opt }) });
+    }
+  }
+  foreach (mixed *field : state->command[COMMAND_FIELDS]) {
+    if (member(state->extra, field[FIELD_ID])) {
+      given += ({ ({ field, "extra", field[FIELD_ID] }) });
+    }
+  }
+
+  string *patterns = ({ });
+  string *ospecs = ({ });
+  foreach (mixed *item : given) {
+    mixed *field = item[0];
+    if (member(state->model, field[FIELD_ID])) {
+      continue;
+    }
+    switch (field[FIELD_TYPE]) {
+      case "file":
+      case "files":
+        patterns += explode_args(field_arg(state, field, item[1], item[2]));
+        break;
+      case "object":
+      case "objects":
+        ospecs += ({ field_arg(state, field, item[1], item[2]) });
+        break;
+    }
+  }
+
+  state->expanded_files = 
+    (sizeof(patterns) ? expand_patterns(patterns, THISP) : ([ ]));
+  state->expanded_objects = 
+    (sizeof(ospecs) ? expand_object_batch(ospecs, THISP) : ([ ]));
+}
+
+/**
+ * Get the input string for a field from the args, opts, or extra fields of
+ * the command state.
+ * 
+ * @param  state         the command state, a struct containing all the 
+ *                       information about the command-to-be-executed we have
+ *                       so far
+ * @param  field         the field info from the parsed command spec
+ * @param  field_type    field type: "args", "opts", or "extra"
+ * @param  index         field index, int for arg position, string for opts or
+ *                       extra field ids
+ * @return the trimmed input string
+ */
+string field_arg(struct CommandState state, mixed *field, string field_type, 
+                 mixed index) {
+  mixed arg = get_struct_member(state, field_type)[index];
+  if (pointerp(arg)) {
+    // parsed opts hold a param for each time they were given, last one wins
+    if (field[FIELD_TYPE] == "bool") {
+      arg = TRUE_VALUE;
+    } else {
+      arg = (sizeof(arg) ? arg[<1] : 0);
+    }
+  }
+  return trim(arg || "", TRIM_BOTH);
+}
+
 /**
  * Parse a field value from an input arg/opt/extra string. This should apply
  * the correct type parser, and update the field value by reference.
@@ -477,9 +785,7 @@ public int field_input(string input, struct CommandState state, mixed *field,
  */
 string parse_value(struct CommandState state, mixed *field, string field_type, 
                    mixed index, mixed val) {
-  string id = field[FIELD_ID];
-  string arg = get_struct_member(state, field_type)[index];
-  arg = trim(arg || "", TRIM_BOTH);
+  string arg = field_arg(state, field, field_type, index);
   switch (field[FIELD_TYPE]) {
     case "bool":
       return parse_boolean(arg, &val);
@@ -490,13 +796,13 @@ string parse_value(struct CommandState state, mixed *field, string field_type,
     case "enum":
       return parse_enum(arg, &val, field[FIELD_ENUM]);
     case "file":
-      return parse_file(arg, &val);
+      return parse_file(arg, &val, state->expanded_files);
     case "files":
-      return parse_files(arg, &val);
+      return parse_files(arg, &val, state->expanded_files);
     case "object":
-      return parse_object(arg, &val);
+      return parse_object(arg, &val, state->expanded_objects);
     case "objects":
-      return parse_objects(arg, &val);
+      return parse_objects(arg, &val, state->expanded_objects);
     case "string":
     default:
       val = arg;
@@ -609,11 +915,12 @@ string parse_enum(string arg, mixed val, mixed *enum) {
  * 
  * @param  arg           the value string
  * @param  val           the value to set to filename, passed by reference
+ * @param  expanded      a mapping of already expanded patterns to files
  * @return a fail message, or 0 if value was parsed successfully
  */
-string parse_file(string arg, mixed val) {
+string parse_file(string arg, mixed val, mapping expanded) {
   mixed result;
-  string err = parse_files(arg, &result);
+  string err = parse_files(arg, &result, expanded);
   if (err) {
     return err;
   }
@@ -632,13 +939,18 @@ string parse_file(string arg, mixed val) {
  * @param  arg           the value string
  * @param  val           the value to set to an array of filenames, passed by 
  *                       reference
+ * @param  expanded      a mapping of already expanded patterns to files
  * @return a fail message, or 0 if value was parsed successfully
  */
-string parse_files(string arg, mixed val) {
+string parse_files(string arg, mixed val, mapping expanded) {
   string *args = explode_args(arg);
   mixed *result = ({ });
   foreach (string pattern : args) {
-    result += expand_pattern(pattern, THISP);
+    if (expanded && member(expanded, pattern)) {
+      result += expanded[pattern];
+    } else {
+      result += expand_pattern(pattern, THISP);
+    }
   }
   val = result;
   return 0;
@@ -649,11 +961,12 @@ string parse_files(string arg, mixed val) {
  * 
  * @param  arg           the value string
  * @param  val           the value to set to an object, passed by reference
+ * @param  expanded      a mapping of already expanded ospecs to objects
  * @return a fail message, or 0 if value was parsed successfully
  */
-string parse_object(string arg, mixed val) {
+string parse_object(string arg, mixed val, mapping expanded) {
   mixed result;
-  string err = parse_objects(arg, &result);
+  string err = parse_objects(arg, &result, expanded);
   if (err) {
     return err;
   }
@@ -671,10 +984,15 @@ string parse_object(string arg, mixed val) {
  * 
  * @param  arg           the value string
  * @param  val           the value to set to object array, passed by reference
+ * @param  expanded      a mapping of already expanded ospecs to objects
  * @return a fail message, or 0 if value was parsed successfully
  */
-string parse_objects(string arg, mixed val) {
-  val = expand_objects(arg, THISP, 0);
+string parse_objects(string arg, mixed val, mapping expanded) {
+  if (expanded && member(expanded, arg)) {
+    val = expanded[arg];
+  } else {
+    val = expand_objects(arg, THISP, 0);
+  }
   return 0;
 }
 
@@ -700,11 +1018,7 @@ varargs int do_validate(struct CommandState state, closure callback,
       int valid = validate(field[FIELD_VALIDATION], state, 
                            state->model[field[FIELD_ID]], field, retry_test);
       if (valid == VALIDATION_RETRY) {
-        state->form_retry += 1;
-        state->model = ([ ]);
-        state->force_prompt = 1;
-        process_command(state, callback);
-        return 0;
+        return retry_form(state, callback);
       } else if (valid == VALIDATION_FAIL) {
         return 0;
       }
@@ -716,11 +1030,7 @@ varargs int do_validate(struct CommandState state, closure callback,
                        + state->command[COMMAND_VALIDATION];
   int valid = validate(validations, state, state->model, 0, retry_test);
   if (valid == VALIDATION_RETRY) {
-    state->form_retry += 1;
-    state->model = ([ ]);
-    state->force_prompt = 1;
-    process_command(state, callback);
-    return 0;
+    return retry_form(state, callback);
   } else if (valid == VALIDATION_FAIL) {
     return 0;
   }
@@ -728,6 +1038,44 @@ varargs int do_validate(struct CommandState state, closure callback,
   return 1;
 }
 
+/**
+ * Retry a form after a failed validation. Rather than throwing the whole 
+ * model away, every field which may be prompted for is marked stale, and 
+ * keeps its value unless new input is given for it. A form validation may
+ * depend on any field, so each of them is prompted for again, not just the
+ * ones which were changed. Fields which can't be prompted for, and fields
+ * whose values were piped from the previous command, are kept as they are.
+ * Processing then starts again from the first stage.
+ * 
+ * @param  state         the command state, a struct containing all the 
+ *                       information about the command-to-be-executed we have
+ *                       so far
+ * @param  callback      the callback to execute the validated command
+ * @return 0 to halt processing
+ */
+int retry_form(struct CommandState state, closure callback) {
+  state->form_retry += 1;
+  mixed *fields = state->command[COMMAND_FIELDS] + state->syntax[SYNTAX_ARGS]
+                  + m_values(state->syntax[SYNTAX_VALID_OPTS]) 
+                  + m_values(state->syntax[SYNTAX_VALID_LONGOPTS]);
+  foreach (mixed *field : fields) {
+    if (member(state->piped, field[FIELD_ID])) {
+      continue;
+    }
+    if ((field[FIELD_PROMPT_SETTING] == PROMPT_VALIDATE)
+        || (field[FIELD_PROMPT_SETTING] == PROMPT_ALWAYS)) {
+      state->stale[field[FIELD_ID]] = 1;
+    }
+  }
+  if (!sizeof(state->stale)) {
+    // nothing can be changed, so the form can't pass
+    return 0;
+  }
+  state->stage = STAGE_ARGS;
+  process_command(state, callback);
+  return 0;
+}
+
 /**
  * Validate command by running one or more validation functions with a 
  * specified value to validate. Will not perform a retry, but will perform a
@@ -751,21 +1099,28 @@ varargs int do_validate(struct CommandState state, closure callback,
  */
 int validate(mixed *validations, struct CommandState state, mixed val, 
              mixed *field, closure retry_test) {
+  string specfile = state->command[COMMAND_SPECFILE];
+  mapping compiled = validators[specfile];
+  if (!compiled) {
+    compiled = validators[specfile] = ([ ]);
+  }
   foreach (mixed *validation : validations) {
-    // invoke validation function
-    string func = VALIDATION_PREFIX + validation[VALIDATE_VALIDATOR];
-    closure validator = symbol_function(func, THISO);
+    closure validator = compiled[validation];
     if (!validator) {
-      stderr_msg(funcall(fail_formatter, sprintf(
-        "Validator not found: %s.\n", 
-        validation[VALIDATE_VALIDATOR]
-      ), state->verb));
+      validator = compile_validator(validation);
+      if (!validator) {
+        // unknown validators are also reported when the spec is loaded
+        stderr_msg(funcall(fail_formatter, sprintf(
+          "Validator not found: %s.\n", 
+          validation[VALIDATE_VALIDATOR]
+        ), state->verb));
+        return VALIDATION_FAIL;
+      }
+      compiled[validation] = validator;
     }
 
     // process result
-    int result = apply(validator, val, validation[VALIDATE_PARAMS]);
-    result = (validation[VALIDATE_NEGATE] ? !result : result);
-    if (!result) {
+    if (!funcall(validator, val)) {
       // validation failed
       stderr_msg(funcall(fail_formatter, validation[VALIDATE_FAIL], 
                          state->verb));
@@ -779,6 +1134,306 @@ int validate(mixed *validations, struct CommandState state, mixed val,
   return VALIDATION_PASS;
 }
 
+/**
+ * Compile a validation into a closure bound to this controller. The closure
+ * takes the value to validate, and calls the validator function with the 
+ * validation's params, negating the result if necessary.
+ * 
+ * @param  validation    the validation
+ * @return the validator closure, or 0 if this controller doesn't define the
+ *         validator function
+ */
+closure compile_validator(mixed *validation) {
+  closure validator = symbol_function(
+    VALIDATION_PREFIX + validation[VALIDATE_VALIDATOR], THISO
+  );
+  if (!validator) {
+    return 0;
+  }
+  mixed *body = ({ #'funcall, validator, 'val }) //'
+                + validation[VALIDATE_PARAMS];
+  if (validation[VALIDATE_NEGATE]) {
+    body = ({ #'!, body }); //'
+  }
+  return lambda(({ 'val }), body); //'
+}
+
+/**
+ * Drop the compiled validators of a spec file's commands, and the parsers 
+ * bound to this controller. Called by the CommandSpecTracker when the spec
+ * is reloaded, since the reloaded commands have new validations and 
+ * parsers.
+ * 
+ * @param  specfile      the spec filename
+ */
+public void release_spec(string specfile) {
+  m_delete(validators, specfile);
+  clear_bound_parsers();
+}
+
+/**
+ * Run the callback for a validated command. The results of cacheable 
+ * commands are cached along with the messages they sent the user, and 
+ * replayed when the same player gives the command again with the same model
+ * in the same working directory, until a file the model refers to is 
+ * written.
+ * 
+ * @param  state         the command state
+ * @param  callback      the callback to execute the validated command
+ * @return the result of the callback, or 0 if the command failed
+ */
+mapping execute_command(struct CommandState state, closure callback) {
+  string key = cache_key(state);
+  if (!key) {
+    return run_limited(state, callback);
+  }
+
+  mixed *entry = result_cache[key];
+  if (entry) {
+    foreach (mixed *msg : entry[CACHE_MESSAGES]) {
+      if (msg[CAPTURED_STDERR]) {
+        MessageLib::stderr_msg(msg[CAPTURED_MESSAGE], 
+                               deep_copy(msg[CAPTURED_CONTEXT]), THISP, 
+                               msg[CAPTURED_TOPIC]);
+      } else {
+        MessageLib::stdout_msg(msg[CAPTURED_MESSAGE], 
+                               deep_copy(msg[CAPTURED_CONTEXT]), THISP, 
+                               msg[CAPTURED_TOPIC]);
+      }
+    }
+    return deep_copy(entry[CACHE_RESULT]);
+  }
+
+  captured = ({ });
+  capture_eval = debug_info(DINFO_EVAL_NUMBER);
+  mapping result = run_limited(state, callback);
+  mixed *messages = captured;
+  captured = 0;
+  if (result) {
+    cache_result(key, state, result, messages);
+  }
+  return result;
+}
+
+/**
+ * Get the result cache key for a command state. The key is made of the 
+ * player, the verb, the working directory, and the parsed model with its 
+ * fields in a fixed order, so equivalent command lines share an entry. 
+ * Entries are never shared between players, since the output may depend on
+ * who gave the command.
+ * 
+ * @param  state         the command state
+ * @return the cache key, or 0 if the command isn't cacheable or its model
+ *         refers to objects, whose state can't be tracked
+ */
+string cache_key(struct CommandState state) {
+  if (!state->command[COMMAND_CACHEABLE]) {
+    return 0;
+  }
+  string result = sprintf("%s\n%s\n%s", object_name(THISP), state->verb, 
+                          THISP->query_cwd() || "");
+  foreach (string id : sort_array(m_indices(state->model), #'>)) { //'
+    mixed val = state->model[id];
+    if (objectp(val) 
+        || (pointerp(val) && sizeof(filter(val, #'objectp)))) { //'
+      return 0;
+    }
+    result += sprintf("\n%s=%O", id, val);
+  }
+  return result;
+}
+
+/**
+ * Cache the result of a cacheable command. The entry is dropped when any
+ * file or directory the model refers to is written, or any file in one of
+ * their directories, or the working directory itself. When the cache is 
+ * full it's emptied before the entry is added.
+ * 
+ * @param  key           the cache key, see cache_key()
+ * @param  state         the command state
+ * @param  result        the result of the command
+ * @param  messages      the messages the command sent the user
+ */
+void cache_result(string key, struct CommandState state, mapping result,
+                  mixed *messages) {
+  if (!watching_cache) {
+    FileTracker->subscribe(CACHE_WATCH_REGEX, #'cache_signal); //'
+    watching_cache = 1;
+  }
+  if (sizeof(result_cache) >= CACHE_MAX_ENTRIES) {
+    result_cache = ([ ]);
+    cached_paths = ([ ]);
+  }
+
+  mapping paths = ([ ]);
+  string cwd = THISP->query_cwd();
+  if (cwd) {
+    paths += ([ cwd ]);
+  }
+  foreach (string id, mixed val : state->model) {
+    // file fields hold get_dir() style entries, see parse_files()
+    mixed *files = (pointerp(val) && sizeof(val) && pointerp(val[0]) 
+                    ? val : ({ val }));
+    foreach (mixed file : files) {
+      if (pointerp(file) && sizeof(file) && stringp(file[0])) {
+        paths += ([ file[0], dirname(file[0]) ]);
+      }
+    }
+  }
+
+  result_cache[key] = ({ deep_copy(result), messages, m_indices(paths) });
+  foreach (string path : paths) {
+    cached_paths[path] ||= ([ ]);
+    cached_paths[path] += ([ key ]);
+  }
+}
+
+/**
+ * Called when any file is modified or removed, once this controller has 
+ * cached a result. Drops the cached results which depend on the file or
+ * its directory; writes to any other path are ignored.
+ *
+ * @param  file          path to the file
+ * @param  func          write method (see valid_write())
+ */
+public void cache_signal(string file, string func) {
+  if (file[0] != '/') {
+    file = "/" + file;
+  }
+  foreach (string path : ({ file, dirname(file) })) {
+    mapping keys = cached_paths[path];
+    if (!keys) {
+      continue;
+    }
+    m_delete(cached_paths, path);
+    foreach (string key : keys) {
+      m_delete(result_cache, key);
+    }
+  }
+}
+
+/**
+ * Run the callback for a validated command within the command's execution
+ * budget, see query_budget(). A command which runs over its budget is
+ * aborted with a failure message, and the overrun is counted against this
+ * controller in the MetricsService. Overruns are recognised by the error 
+ * the driver raises for them. Any other error is raised again, after the
+ * catch has logged it with its original trace.
+ * 
+ * @param  state         the command state
+ * @param  callback      the callback to execute the validated command
+ * @return the result of the callback, or 0 if the command was aborted
+ */
+mapping run_limited(struct CommandState state, closure callback) {
+  int *budget = query_budget(state->command);
+  if (!budget) {
+    return funcall(callback, state->model, state->verb);
+  }
+
+  int *limits = allocate(LIMIT_MAX, LIMIT_KEEP);
+  limits[LIMIT_EVAL] = budget[BUDGET_EVAL] || LIMIT_KEEP;
+  limits[LIMIT_ARRAY] = budget[BUDGET_ARRAY] || LIMIT_KEEP;
+  limits[LIMIT_MAPPING] = budget[BUDGET_MAPPING] || LIMIT_KEEP;
+  limits[LIMIT_BYTE] = budget[BUDGET_BYTE] || LIMIT_KEEP;
+  mapping result;
+  string err = catch(
+    result = limited(callback, limits, state->model, state->verb));
+  if (!err) {
+    return result;
+  }
+
+  string metric;
+  if (sizeof(regexp(({ err }), BUDGET_EVAL_REGEX))) {
+    metric = METRIC_EVAL_OVERRUN;
+  } else if (sizeof(regexp(({ err }), BUDGET_ERROR_REGEX))) {
+    metric = METRIC_MEMORY_OVERRUN;
+  } else {
+    raise_error(err);
+  }
+  MetricsService->increment(metric, object_name(THISO));
+  stderr_msg(funcall(fail_formatter, 
+    "Command aborted, it exceeded its resource budget.\n", state->verb));
+  return 0;
+}
+
+/**
+ * Get the execution budget of a command. Budgets given by the command spec
+ * take precedence, and any others are taken from the default command budget
+ * of the controller's domain. The domain default is looked up once, and 
+ * again only after the DomainTracker's config changes.
+ * 
+ * @param  command       the command info as loaded from the command spec
+ * @return the budget; see BUDGET_* in command.h, or 0 if the command has
+ *         no budget
+ */
+int *query_budget(mixed *command) {
+  int *budget = command[COMMAND_BUDGET];
+  int *defaults;
+  object tracker = FINDO(DomainTracker);
+  if (tracker) {
+    if (!domain_budget || (domain_budget[0] != tracker)
+        || (domain_budget[1] != tracker->query_config_version())) {
+      // looking up the domain may load its config, so take the version last
+      defaults = tracker->query_command_budget(
+        tracker->query_domain_id(program_name(THISO)));
+      domain_budget = ({ tracker, tracker->query_config_version(), 
+                         defaults });
+    }
+    defaults = domain_budget[2];
+  }
+  if (!defaults) {
+    return budget;
+  }
+  if (!budget) {
+    return defaults;
+  }
+  int *result = allocate(BUDGET_SIZE);
+  for (int i = 0; i < BUDGET_SIZE; i++) {
+    result[i] = budget[i] || defaults[i];
+  }
+  return result;
+}
+
+/**
+ * Send a message over STDOUT, see MessageLib. Messages to this player are
+ * captured while a cacheable command runs, so they can be replayed from 
+ * the result cache.
+ * 
+ * @param  message       the message to send
+ * @param  context       the message context
+ * @param  ob            the target object
+ * @param  topic         the message topic, optional
+ * @return the sent message, or 0 if it could not be sent
+ */
+protected varargs struct Message stdout_msg(string message, mapping context,
+                                            object ob, string topic) {
+  if (captured && (capture_eval == debug_info(DINFO_EVAL_NUMBER))
+      && (!ob || (ob == THISP))) {
+    captured += ({ ({ 0, message, deep_copy(context), topic }) });
+  }
+  return MessageLib::stdout_msg(message, context, ob, topic);
+}
+
+/**
+ * Send a message over STDERR, see MessageLib. Messages to this player are
+ * captured while a cacheable command runs, so they can be replayed from 
+ * the result cache.
+ * 
+ * @param  message       the message to send
+ * @param  context       the message context
+ * @param  ob            the target object
+ * @param  topic         the message topic, optional
+ * @return the sent message, or 0 if it could not be sent
+ */
+protected varargs struct Message stderr_msg(string message, mapping context,
+                                            object ob, string topic) {
+  if (captured && (capture_eval == debug_info(DINFO_EVAL_NUMBER))
+      && (!ob || (ob == THISP))) {
+    captured += ({ ({ 1, message, deep_copy(context), topic }) });
+  }
+  return MessageLib::stderr_msg(message, context, ob, topic);
+}
+
 /**
  * Run the execution function. 
  * 
@@ -6,14 +6,26 @@
  */
 #pragma no_clone
 #include <sys/functionlist.h>
+#include <sys/strings.h>
+#include <string.h>
 #include <capability.h>
 #include <command_giver.h>
 #include <command.h>
+#include <metrics.h>
 
 private inherit ObjectLib;
 private inherit FileLib;
 private inherit ArrayLib;
-private inherit CommandSpecLib;
+private inherit ArgumentLib;
+private inherit MessageLib;
+
+struct ScriptState {
+  string file;
+  mixed *lines;
+  int line;
+  int paused;
+  mapping errors;
+};
 
 private mapping CAPABILITIES_VAR = ([ CAP_COMMAND_GIVER ]);
 private string CMD_IMPORTS_VAR = 
@@ -21,13 +33,32 @@ private string CMD_IMPORTS_VAR =
 
 private int enabled;
 private nosave mixed *commands;
+// ([ str verb : ({ ({ int order, str verb, str specfile, mixed *command,
+//                     str controller }), ... }) ])
+private nosave mapping verb_index;
+// lengths of indexed verbs containing spaces, longest first
+private nosave int *phrase_lengths;
+// ([ int script_id : ScriptState script ])
+private nosave mapping scripts = ([ ]);
+private nosave int script_counter;
 
 public void setup();
 public void teardown();
 int is_command_giver();
 mixed *load_cmd_imports();
+protected void index_verbs(mixed *imports);
+protected mixed *match_verbs(string arg);
 public int do_command(string arg);
+protected int run_batch(string *lines);
+protected int run_pipeline(string arg);
+protected mixed dispatch_command(string arg, mapping pipe);
 public int run_script(string script_file);
+protected void run_script_slice(int id);
+public int pause_script(int id);
+public int resume_script(int id);
+public int abort_script(int id);
+public mixed *query_script(int id);
+public int *query_scripts();
 protected object load_controller(string controller);
 
 /**
@@ -58,7 +89,8 @@ int is_command_giver() {
 
 /**
  * Introspect the inherit tree for the command imports variable assignments and 
- * load the configured command specs from disk.
+ * load the configured command specs from the CommandSpecTracker. The verb
+ * index used by do_command() is rebuilt from the loaded specs.
  * 
  * @return a 2-dimensional array of command spec and the parsed command data
  */
@@ -70,10 +102,81 @@ mixed *load_cmd_imports() {
   while ((i = member(vars,  CMD_IMPORTS_VAR_STR, i)) != -1) {
     mixed val = vars[++i];
     if (stringp(val)) {
-      result += ({ ({ val, load_command_spec(val) }) });
+      result += ({ ({ val, CommandSpecTracker->query_command_spec(val) }) });
     }
     i++;
   }
+  index_verbs(result);
+  return result;
+}
+
+/**
+ * Build the verb index from a list of loaded command specs. Every verb maps to
+ * the commands which define it, tagged with their position in the import
+ * order so that first-match-wins can be preserved across spec files, and the
+ * controller path resolved against its spec file ahead of time. Verbs
+ * containing spaces can't be found by the first word of a command line, so 
+ * their lengths are recorded separately and probed by prefix.
+ * 
+ * @param  imports       the command specs, as returned by load_cmd_imports()
+ */
+protected void index_verbs(mixed *imports) {
+  mapping lengths = ([ ]);
+  int order = 0;
+  verb_index = ([ ]);
+  foreach (mixed *cmd : imports) {
+    string specfile = cmd[0];
+    foreach (mixed *command : cmd[1]) {
+      string controller = expand_path(command[COMMAND_CONTROLLER], specfile);
+      foreach (string verb : command[COMMAND_VERBS]) {
+        if (!stringp(verb) || !strlen(verb)) {
+          continue;
+        }
+        if (!member(verb_index, verb)) {
+          verb_index[verb] = ({ });
+        }
+        verb_index[verb] += ({ 
+          ({ order++, verb, specfile, command, controller }) 
+        });
+        if (member(verb, ' ') != -1) {
+          lengths += ([ strlen(verb) ]);
+        }
+      }
+    }
+  }
+  phrase_lengths = sort_array(m_indices(lengths), #'<); //'
+}
+
+/**
+ * Look up the commands whose verb matches the beginning of a command line. A
+ * verb matches if it is followed by a space or the end of the line.
+ * 
+ * @param  arg           the command line
+ * @return an array of verb index entries, in import order
+ */
+protected mixed *match_verbs(string arg) {
+  if (!verb_index) {
+    return ({ });
+  }
+  int arglen = strlen(arg);
+  int space = member(arg, ' ');
+  string word = (space == -1 ? arg : arg[0..(space - 1)]);
+  mixed *result = verb_index[word] || ({ });
+
+  int phrases = 0;
+  foreach (int len : phrase_lengths) {
+    if ((len > arglen) || ((len < arglen) && (arg[len] != ' '))) {
+      continue;
+    }
+    string phrase = arg[0..(len - 1)];
+    if ((member(phrase, ' ') != -1) && member(verb_index, phrase)) {
+      result += verb_index[phrase];
+      phrases = 1;
+    }
+  }
+  if (phrases) {
+    result = sort_array(result, (: $1[VERB_ORDER] > $2[VERB_ORDER] :));
+  }
   return result;
 }
 
@@ -82,118 +185,291 @@ mixed *load_cmd_imports() {
  * through this action function to parse out the verb and argument portion of
  * the command. Then control will be routed to the associated command 
  * controller for validation and execution.
+ *
+ * Several commands may be given at once by separating them with unquoted 
+ * ';' characters, in which case they are run as a batch; see run_batch().
+ * Since unquoted '|' and ';' characters always split the command line, an
+ * argument which contains them, such as a regular expression, must be 
+ * quoted.
  * 
  * @param  arg the command-line argument
  * @return     the result of the command execution; 1 for success, 0 for
  *             failure.
  */
 public int do_command(string arg) {
-  mapping fragments = ([ ]); // len to fragment 
-  mapping matched = ([ ]);  // verb to arg
-  int arglen = strlen(arg);
+  if (member(arg, ';') == -1) {
+    return run_pipeline(arg);
+  }
+  string *lines = explode_nested(arg, ";", QUOTE_CHARS, QUOTE_CHARS);
+  if (!lines) {
+    // unbalanced quotes, let the command sort it out
+    return run_pipeline(arg);
+  }
+  lines = filter(map(lines, #'trim, TRIM_BOTH, ' '), #'strlen); //'
+  if (sizeof(lines) < 2) {
+    return sizeof(lines) ? run_pipeline(lines[0]) : 0;
+  }
+  return run_batch(lines);
+}
+
+/**
+ * Run a batch of commands given on a single line. Output is held back while
+ * the batch runs and sent all at once when it's done, along with only the
+ * last prompt. Like a shell, a failed command doesn't stop the batch, but a 
+ * command which prompts for input does, since the rest of the batch would 
+ * otherwise run ahead of the input it's waiting for.
+ * 
+ * @param  lines         the commands to run
+ * @return the result of the last command run; 1 for success, 0 for failure
+ */
+protected int run_batch(string *lines) {
+  int prompts = sizeof(input_to_info(THISO));
   int result = 0;
-  foreach (mixed *cmd : commands) {
-    string specfile = cmd[0];
-    foreach (mixed *command : cmd[1]) {
-      foreach (string verb : command[COMMAND_VERBS]) {
-        if (member(matched, verb)) {
-          if (matched[verb]) {
-            object controller = load_controller(expand_path(
-                                  command[COMMAND_CONTROLLER], specfile));
-            if (controller) {
-              result = controller->do_command(command, verb, matched[verb]);
-            }
-            // TODO notify broken controller via result
-            if (result) {
-              break;
-            }
-          } else {
-            continue;
-          }
-        }
-        int len = strlen(verb);
-        if (len > arglen) {
-          continue;
-        }
-        if (!member(fragments, len)) {
-          fragments[len] = arg[0..(len - 1)];
-        }
-        if (fragments[len] == verb) {
-          if (len == arglen) {
-            matched[verb] = "";
-          } else if (arg[len] == ' ') {
-            // trim leading spaces
-            int i = len;
-            while (arg[i] == ' ') { 
-              i++;
-            }
-            // set the match
-            if (i < arglen) {
-              matched[verb] = arg[i..];
-            } else {
-              matched[verb] = "";
-            }
-          } else {
-            matched[verb] = 0;
-          }
-        } else {
-          matched[verb] = 0;
-        }
+  string err;
+  PostalService->hold_messages(THISO);
+  foreach (string line : lines) {
+    // raised again once the held output is released, which reports it
+    if (err = catch(result = run_pipeline(line))) {
+      break;
+    }
+    if (sizeof(input_to_info(THISO)) > prompts) {
+      break;
+    }
+  }
+  PostalService->release_messages(THISO);
+  if (err) {
+    raise_error(err);
+  }
+  return result;
+}
 
-        if (matched[verb]) {
-          object controller = load_controller(expand_path(
-                                command[COMMAND_CONTROLLER], specfile));
-          if (controller) {
-            result = controller->do_command(command, verb, matched[verb]);
-          }
-          if (result) {
-            break;
-          }
-        }
-      }
-      if (result) {
-        break;
-      }
+/**
+ * Run a single command line. Commands may be chained into a pipeline with 
+ * unquoted '|' characters, in which case the output model of each command is
+ * handed to the controller of the next. The pipeline stops at the first 
+ * command which fails or prompts for input.
+ * 
+ * @param  arg           the command line
+ * @return the result of the command execution; 1 for success, 0 for failure
+ */
+protected int run_pipeline(string arg) {
+  if (member(arg, '|') == -1) {
+    return dispatch_command(arg, 0) ? 1 : 0;
+  }
+
+  string *stages = explode_nested(arg, "|", QUOTE_CHARS, QUOTE_CHARS);
+  if (!stages) {
+    // unbalanced quotes, let the command sort it out
+    return dispatch_command(arg, 0) ? 1 : 0;
+  }
+
+  mixed result = 0;
+  mapping pipe = 0;
+  foreach (string stage : stages) {
+    result = dispatch_command(trim(stage, TRIM_BOTH, ' '), pipe);
+    if (!result) {
+      break;
     }
+    pipe = (mappingp(result) ? result : ([ ]));
+  }
+  return result ? 1 : 0;
+}
+
+/**
+ * Route a single command to its controller.
+ * 
+ * @param  arg           the command-line argument
+ * @param  pipe          the output model of the previous command in the
+ *                       pipeline, or 0
+ * @return the result of the command execution, or 0 for failure
+ */
+protected mixed dispatch_command(string arg, mapping pipe) {
+  int arglen = strlen(arg);
+  mixed result = 0;
+  foreach (mixed *match : match_verbs(arg)) {
+    string verb = match[VERB_VERB];
+    // commands are indexed lazily, this builds them on first use
+    mixed *command = CommandSpecTracker->query_command(match[VERB_COMMAND]);
+
+    // trim leading spaces
+    int i = strlen(verb);
+    while ((i < arglen) && (arg[i] == ' ')) {
+      i++;
+    }
+
+    object controller = load_controller(match[VERB_CONTROLLER]);
+    if (controller && command) {
+      int ticks = get_eval_cost();
+      int *start = utime();
+      result = controller->do_command(command, verb, arg[i..], pipe);
+      int *end = utime();
+      MetricsService->record(METRIC_VERB, verb, ticks - get_eval_cost(),
+        ((end[0] - start[0]) * 1000000) + (end[1] - start[1]));
+    }
+    // TODO notify broken controller via result
     if (result) {
       break;
-    }    
+    }
   }
   
   return result;
 }
 
 /**
- * Simple script handling supporting basic source files.
+ * Simple script handling supporting basic source files. The script is read 
+ * and split into lines once, then run in call_out slices so that long scripts
+ * don't exceed the eval limit or stall other users. Each slice runs lines 
+ * until SCRIPT_SLICE_TICKS have been spent. Errors are reported per line, 
+ * and a running script may be paused, resumed or aborted by its id.
  * 
  * @param  script_file   the script file
- * @return 1 for success, 0 for failure
+ * @return the script id, or 0 for failure
  */
 public int run_script(string script_file) {
   string script = read_file(script_file);
   if (!script) {
     return 0;
   }
-  string *lines = explode(script, "\n");
-  foreach (string line : lines) {
-    command(line);
+  mixed *lines = ({ });
+  string *source = explode(script, "\n");
+  int numlines = sizeof(source);
+  for (int i = 0; i < numlines; i++) {
+    if (strlen(trim(source[i], TRIM_BOTH, " \t\r"))) {
+      lines += ({ ({ i + 1, source[i] }) });
+    }
+  }
+
+  int id = ++script_counter;
+  scripts[id] = (<ScriptState> 
+    file: script_file, 
+    lines: lines, 
+    line: 0, 
+    paused: 0, 
+    errors: ([ ]));
+  run_script_slice(id);
+  return id;
+}
+
+/**
+ * Run the next slice of a script. Lines are run until the slice budget is 
+ * spent, then another slice is scheduled.
+ * 
+ * @param  id            the script id
+ */
+protected void run_script_slice(int id) {
+  struct ScriptState script = scripts[id];
+  if (!script || script->paused) {
+    return;
+  }
+
+  int start = get_eval_cost();
+  int numlines = sizeof(script->lines);
+  while (script->line < numlines) {
+    if (((start - get_eval_cost()) >= SCRIPT_SLICE_TICKS)
+        || (get_eval_cost() < SCRIPT_EVAL_RESERVE)) {
+      break;
+    }
+    mixed *line = script->lines[script->line++];
+    int result;
+    string err = catch(result = command(line[SCRIPT_LINE_TEXT]));
+    if (err || !result) {
+      err ||= "command failed\n";
+      script->errors[line[SCRIPT_LINE_NUMBER]] = err;
+      stderr_msg(sprintf("%s line %d: %s", script->file, 
+                         line[SCRIPT_LINE_NUMBER], err), 0, THISO);
+    }
+    if (script->paused || !member(scripts, id)) {
+      // paused or aborted by the line itself
+      return;
+    }
+  }
+
+  if (script->line < numlines) {
+    call_out(#'run_script_slice, 0, id); //'
+  } else {
+    m_delete(scripts, id);
+  }
+}
+
+/**
+ * Pause a running script. It will stop after the current line.
+ * 
+ * @param  id            the script id
+ * @return 1 for success, 0 if the script isn't running
+ */
+public int pause_script(int id) {
+  struct ScriptState script = scripts[id];
+  if (!script || script->paused) {
+    return 0;
+  }
+  script->paused = 1;
+  return 1;
+}
+
+/**
+ * Resume a paused script from where it left off.
+ * 
+ * @param  id            the script id
+ * @return 1 for success, 0 if the script isn't paused
+ */
+public int resume_script(int id) {
+  struct ScriptState script = scripts[id];
+  if (!script || !script->paused) {
+    return 0;
+  }
+  script->paused = 0;
+  call_out(#'run_script_slice, 0, id); //'
+  return 1;
+}
+
+/**
+ * Abort a running or paused script.
+ * 
+ * @param  id            the script id
+ * @return 1 for success, 0 if there's no such script
+ */
+public int abort_script(int id) {
+  if (!member(scripts, id)) {
+    return 0;
   }
+  m_delete(scripts, id);
   return 1;
 }
 
 /**
- * Attempt to load a command controller object.
+ * Get the progress of a running or paused script.
+ * 
+ * @param  id            the script id
+ * @return an array of script file, lines run, total lines, paused flag and 
+ *         a mapping of line numbers to errors, or 0 if there's no such 
+ *         script; see SCRIPT_INFO_* in command_giver.h
+ */
+public mixed *query_script(int id) {
+  struct ScriptState script = scripts[id];
+  if (!script) {
+    return 0;
+  }
+  return ({ script->file, script->line, sizeof(script->lines), 
+            script->paused, copy(script->errors) });
+}
+
+/**
+ * Get the ids of all running or paused scripts.
+ * 
+ * @return an array of script ids
+ */
+public int *query_scripts() {
+  return sort_array(m_indices(scripts), #'>); //'
+}
+
+/**
+ * Attempt to load a command controller object. Controller handles are cached
+ * by the CommandSpecTracker.
  * 
  * @param  controller    the path to the controller
  * @return the loaded controller object
  */
 protected object load_controller(string controller) {
-  object result;
-  object logger = LoggerFactory->get_logger(THISO);
-  string err = catch(result = load_object(controller); publish);
-  if (err) {
-    logger->info("error loading controller %s: %s", controller, err);
-  }
-  return result;
+  return CommandSpecTracker->query_controller(controller);
 }
 
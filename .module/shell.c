@@ -4,6 +4,7 @@
  */
 #include <capability.h>
 #include <command_giver.h>
+#include <logger.h>
 
 // TODO environment variables
 // TODO prompt
@@ -18,6 +19,8 @@ private string CMD_IMPORTS_VAR = PlatformBinDir "/shell/shell.cmds";
 private int enabled;
 private string cwd, homedir, *dirstack, context;
 
+LOGGER_HANDLE
+
 public void setup();
 public void teardown();
 int has_shell();
@@ -162,7 +165,7 @@ string query_context() {
  * @return   1 for success, 0 for failure
  */
 int set_context(string c) {
-  LoggerFactory->get_logger(THISO)->trace("set_context(%O)", c);
+  LOG_TRACE(("set_context(%O)", c));
   if (!stringp(c)) {
     return 0;
   }
@@ -1,5 +1,9 @@
 /**
- * The service providing driver hooks.
+ * The service providing driver hooks. Commands are rate limited per 
+ * connection by a token bucket; commands issued faster than the limit 
+ * allows are queued and run from call_outs as tokens become available, and
+ * commands beyond the queue limit are dropped. Limits are configured per
+ * domain and user class with the rateLimit directive of domain.xml.
  *
  * @author devo@eotl
  * @alias HookService
@@ -8,8 +12,23 @@
 #include <sys/driver_hook.h>
 #include <object.h>
 #include <sql.h>
+#include <metrics.h>
+#include <rate_limit.h>
 
 private inherit ObjectLib;
+private inherit MessageLib;
+
+struct CommandBucket {
+  string user_class;
+  mixed *limit;
+  float tokens;
+  int last_refill;
+  string *queue;
+  int draining;
+};
+
+// ([ obj command_giver : CommandBucket bucket ])
+private nosave mapping buckets = ([ ]);
 
 public void setup();
 public void telnet_neg_hook(int action, int option, int *opts);
@@ -17,6 +36,12 @@ public string auto_include_hook(string base_file, string current_file,
                                 int sys);
 public varargs mixed uids_hook(string objectname, object blueprint);
 public int command_hook(string command, object command_giver);
+protected struct CommandBucket query_bucket(object command_giver);
+protected void refill_bucket(struct CommandBucket bucket);
+protected void drain_commands(object command_giver);
+protected void schedule_drain(object command_giver, 
+                              struct CommandBucket bucket);
+public mapping query_rate_limit_counters();
 public void move_object_hook(object item, object dest);  
 protected void track_object(object ob);
 public int create_hook(object ob);  
@@ -74,17 +99,161 @@ public varargs mixed uids_hook(string objectname, object blueprint) {
 
 /**
  * Command hook. Runs whenever a user command is executed. Defers to 
- * do_command() in the command giver.
+ * do_command() in the command giver, if the command giver's rate limit 
+ * allows it. Otherwise the command is queued behind any other pending
+ * commands, or dropped if the queue is full, and the command giver is told
+ * to slow down. Queued commands count as found, since they will be run.
  * 
  * @param  command       the command being executed
  * @param  command_giver the command giver
- * @return 1 if command was found and executed, otherwise 0
+ * @return 1 if command was found and executed or queued, otherwise 0
  */
 public int command_hook(string command, object command_giver) {
-  if (command_giver->is_command_giver()) {
+  if (!command_giver->is_command_giver()) {
+    return 0;
+  }
+  struct CommandBucket bucket = query_bucket(command_giver);
+  refill_bucket(bucket);
+  if (!sizeof(bucket->queue) && (bucket->tokens >= 1.0)) {
+    bucket->tokens -= 1.0;
     return command_giver->do_command(command);
   }
-  return 0;
+
+  if (sizeof(bucket->queue) >= bucket->limit[RATE_LIMIT_QUEUE]) {
+    MetricsService->increment(METRIC_DROPPED, bucket->user_class);
+    stderr_msg(sprintf("Too many commands pending, ignoring: %s\n", command),
+               0, command_giver);
+    return 1;
+  }
+  MetricsService->increment(METRIC_THROTTLED, bucket->user_class);
+  if (!sizeof(bucket->queue)) {
+    stderr_msg("Slow down! Your commands are being queued.\n", 0, 
+               command_giver);
+  }
+  bucket->queue += ({ command });
+  schedule_drain(command_giver, bucket);
+  return 1;
+}
+
+/**
+ * Get the token bucket of a command giver, creating a full one if it 
+ * doesn't have one yet. The limit is looked up once, from the domain of 
+ * the command giver's program and its user class, which is "user" for 
+ * command givers with a username and "guest" otherwise.
+ * 
+ * @param  command_giver the command giver
+ * @return the command giver's bucket
+ */
+protected struct CommandBucket query_bucket(object command_giver) {
+  struct CommandBucket bucket = buckets[command_giver];
+  if (bucket) {
+    return bucket;
+  }
+  string user_class = (command_giver->query_username() ? USER_CLASS_USER 
+                                                        : USER_CLASS_GUEST);
+  mixed *limit;
+  if (FINDO(DomainTracker)) {
+    string domain_id = 
+      DomainTracker->query_domain_id(program_name(command_giver));
+    limit = DomainTracker->query_rate_limit(domain_id, user_class);
+  }
+  limit ||= ({ DEFAULT_RATE_LIMIT_RATE, DEFAULT_RATE_LIMIT_BURST, 
+               DEFAULT_RATE_LIMIT_QUEUE });
+  bucket = (<CommandBucket> 
+    user_class: user_class, 
+    limit: limit, 
+    tokens: to_float(limit[RATE_LIMIT_BURST]), 
+    last_refill: time(), 
+    queue: ({ }), 
+    draining: 0);
+  buckets[command_giver] = bucket;
+  return bucket;
+}
+
+/**
+ * Add the tokens earned since the bucket was last refilled, up to the 
+ * bucket's burst size.
+ * 
+ * @param  bucket        the bucket to refill
+ */
+protected void refill_bucket(struct CommandBucket bucket) {
+  int now = time();
+  if (now > bucket->last_refill) {
+    bucket->tokens += (now - bucket->last_refill) 
+                      * bucket->limit[RATE_LIMIT_RATE];
+    if (bucket->tokens > bucket->limit[RATE_LIMIT_BURST]) {
+      bucket->tokens = to_float(bucket->limit[RATE_LIMIT_BURST]);
+    }
+    bucket->last_refill = now;
+  }
+}
+
+/**
+ * Run as many of a command giver's queued commands as its bucket allows,
+ * and schedule the rest. Each command runs with the command giver as this
+ * player, the same as if it had just been entered.
+ * 
+ * @param  command_giver the command giver
+ */
+protected void drain_commands(object command_giver) {
+  struct CommandBucket bucket = buckets[command_giver];
+  if (!command_giver || !bucket) {
+    return;
+  }
+  bucket->draining = 0;
+  refill_bucket(bucket);
+  object oldp = this_player();
+  set_this_player(command_giver);
+  while (sizeof(bucket->queue) && (bucket->tokens >= 1.0)) {
+    string command = bucket->queue[0];
+    bucket->queue = bucket->queue[1..];
+    bucket->tokens -= 1.0;
+    if (!command_giver->is_command_giver()) {
+      // may have been torn down by an earlier command
+      bucket->queue = ({ });
+      break;
+    }
+    catch(command_giver->do_command(command); publish);
+    if (!command_giver) {
+      break;
+    }
+  }
+  set_this_player(oldp);
+  if (command_giver) {
+    schedule_drain(command_giver, bucket);
+  }
+}
+
+/**
+ * Schedule the next drain of a command giver's queue for when its bucket 
+ * will have earned a token, unless one is already scheduled or the queue 
+ * is empty.
+ * 
+ * @param  command_giver the command giver
+ * @param  bucket        the command giver's bucket
+ */
+protected void schedule_drain(object command_giver, 
+                              struct CommandBucket bucket) {
+  if (!sizeof(bucket->queue) || bucket->draining) {
+    return;
+  }
+  float wait = (1.0 - bucket->tokens) / bucket->limit[RATE_LIMIT_RATE];
+  call_out(#'drain_commands, max(to_int(ceil(wait)), 1), command_giver); //'
+  bucket->draining = 1;
+}
+
+/**
+ * Get the number of commands which have been throttled and dropped by the
+ * rate limiter, per user class.
+ * 
+ * @return a mapping of METRIC_THROTTLED and METRIC_DROPPED to mappings of
+ *         user class to count
+ */
+public mapping query_rate_limit_counters() {
+  return ([ 
+    METRIC_THROTTLED : MetricsService->query_counters(METRIC_THROTTLED),
+    METRIC_DROPPED : MetricsService->query_counters(METRIC_DROPPED)
+  ]);
 }
 
 /**
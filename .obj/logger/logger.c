@@ -19,13 +19,32 @@
 private inherit ObjectExpansionLib;
 private inherit MessageLib;
 #endif
+private inherit JSONLib;
 
 private string zone;
 private mixed *output;
+// whether any output needs formatted messages, or JSON records
+private int human_output, json_output;
 private closure formatter;
+// whether the formatter uses the caller
+private int needs_caller;
+// date formats used by the formatter, and the dates last formatted with them
+private string *date_formats;
+private mapping dates;
+private int dates_time;
 private string level;
 // ([ program : ([ lines... ]) ])
 private mapping muted;
+// ([ str program : ({ int level, object logger }) ]), the handle given to
+// the LOGGER_HANDLE of each program, see query_handle()
+private mapping handles;
+// ring buffer of ({ str message, obj player, mapping record }) waiting to
+// be flushed
+private mixed *buffer;
+private int buffer_start, buffer_count, flush_pending;
+private int overflow, dropped, unreported;
+// ([ str spec : ([ obj player : ({ int time, obj *consoles }) ]) ])
+private mapping consoles;
 
 public void setup();
 string query_zone();
@@ -33,9 +52,14 @@ int set_zone(string str);
 mixed *query_output();
 int set_output(mixed *arr);
 closure query_formatter();
-int set_formatter(closure cl);
+varargs int set_formatter(closure cl, mapping specs);
 string query_level();
 int set_level(string str);
+mixed *query_handle(string program);
+void release_handles();
+int query_overflow();
+int set_overflow(int policy);
+int query_dropped();
 int is_enabled(string priority);
 int is_fatal_enabled();
 int is_error_enabled();
@@ -55,7 +79,13 @@ public void info(string msg_fmt, varargs string *args);
 public void debug(string msg_fmt, varargs string *args);
 public void trace(string msg_fmt, varargs string *args);
 public void log(string priority, string msg_fmt, varargs string *args);
-private void do_output(string msg);
+private mapping format_dates();
+private void do_output(string msg, mapping record);
+private string encode_record(mapping record);
+public void flush_output();
+#ifndef EOTL
+private object *query_consoles(string spec, object who);
+#endif
 private mixed *find_caller();
 private string parse_program(string dbg_program);
 
@@ -65,6 +95,12 @@ private string parse_program(string dbg_program);
 public void setup() {
   seteuid(0);
   muted = ([ ]);
+  date_formats = ({ });
+  dates = ([ ]);
+  handles = ([ ]);
+  buffer = allocate(LOG_BUFFER_SIZE);
+  overflow = DEFAULT_OVERFLOW;
+  consoles = ([ ]);
 }
 
 /**
@@ -94,8 +130,9 @@ int set_zone(string str) {
  *
  *         <code>({ int spec : string target })</code>
  *
- *         where type is one of 'c' or 'f' and target is an object spec or a
- *         file path, for console output or file output, respectively.
+ *         where type is one of 'c', 'f' or 'j' and target is an object spec
+ *         or a file path, for console output, file output, or JSON lines 
+ *         file output, respectively.
  */
 mixed *query_output() {
   return output;
@@ -111,6 +148,17 @@ int set_output(mixed *arr) {
     return 0;
   }
   output = arr;
+  consoles = ([ ]);
+  // debug_message() gets formatted messages when nothing else does
+  human_output = !sizeof(output);
+  json_output = 0;
+  foreach (mixed *target : output) {
+    if (target[0] == OUT_JSON) {
+      json_output = 1;
+    } else {
+      human_output = 1;
+    }
+  }
   return 1;
 }
 
@@ -125,6 +173,8 @@ int set_output(mixed *arr) {
      'caller: an array read from
               <code>debug_info(DINFO_TRACE, DIT_CURRENT)</code>
               for the invoking stackframe, or 0 if no caller was found
+              or the format doesn't use it
+      'dates: a mapping of date formats to the current time in that format
    </pre>
  *
  * @return the formatter closure, bound to LoggerFactory
@@ -135,14 +185,26 @@ closure query_formatter() {
 
 /**
  * Set the formatter.
- * @param  cl the formatter to set
- * @return    1 for success, 0 for failure
+ * @param  cl    the formatter to set
+ * @param  specs the format specifiers used by the formatter, as recorded by
+ *               parse_format(); if omitted, the caller is always looked up
+ *               and no dates are formatted
+ * @return       1 for success, 0 for failure
  */
-int set_formatter(closure cl) {
+varargs int set_formatter(closure cl, mapping specs) {
   if (!check_access()) {
     return 0;
   }
   formatter = cl;
+  if (specs) {
+    needs_caller = sizeof(CALLER_SPECS & m_indices(specs)) > 0;
+    date_formats = m_indices(mkmapping(specs[DATE_SPEC] || ({ })));
+  } else {
+    needs_caller = 1;
+    date_formats = ({ });
+  }
+  dates = ([ ]);
+  dates_time = 0;
   return 1;
 }
 
@@ -164,9 +226,80 @@ int set_level(string str) {
     return 0;
   }
   level = str;
+  foreach (string program, mixed *handle : handles) {
+    handle[HANDLE_LEVEL] = LEVELS[level];
+  }
   return 1;
 }
 
+/**
+ * Get the handle used by the LOG_* macros of a program. Each program gets
+ * a handle of its own, which is updated in place whenever the level 
+ * changes. Handles are only given out through the LoggerFactory, see
+ * LoggerFactory::get_log_handle().
+ *
+ * @param  program the name of the program the handle is for
+ * @return the handle, of the form <code>({ int level, object logger })</code>,
+ *         or 0 if the caller isn't the LoggerFactory
+ */
+mixed *query_handle(string program) {
+  if (object_name(previous_object()) != LoggerFactory) {
+    return 0;
+  }
+  if (!member(handles, program)) {
+    handles[program] = ({ LEVELS[level], THISO });
+  }
+  return handles[program];
+}
+
+/**
+ * Mark every handle given out stale and drop its reference to this logger,
+ * so that their programs fetch a new handle from the LoggerFactory. Only
+ * the LoggerFactory may release handles.
+ */
+void release_handles() {
+  if (object_name(previous_object()) != LoggerFactory) {
+    return;
+  }
+  foreach (string program, mixed *handle : handles) {
+    handle[HANDLE_LEVEL] = LEVEL_STALE;
+    handle[HANDLE_LOGGER] = 0;
+  }
+  handles = ([ ]);
+}
+
+/**
+ * Get the policy for when a message is logged while the output buffer is 
+ * full.
+ * @return one of the OVERFLOW_* constants in logger.h
+ */
+int query_overflow() {
+  return overflow;
+}
+
+/**
+ * Set the output buffer overflow policy.
+ * @param  policy one of OVERFLOW_DROP_OLDEST, OVERFLOW_DROP_NEWEST, or 
+ *                OVERFLOW_FLUSH to write out the buffer synchronously
+ * @return        1 for success, 0 for failure
+ */
+int set_overflow(int policy) {
+  if (!check_access()) {
+    return 0;
+  }
+  overflow = policy;
+  return 1;
+}
+
+/**
+ * Get the number of messages which have been dropped because the output 
+ * buffer was full.
+ * @return the number of dropped messages
+ */
+int query_dropped() {
+  return dropped;
+}
+
 /**
  * Test whether logging is enabled for a specified priority.
  *
@@ -401,25 +534,144 @@ public void log(string priority, string msg_fmt, varargs string *args) {
   }
   seteuid(getuid());
 
-  string msg = apply(#'sprintf, ({ msg_fmt }) + args); //'
-  mixed *caller = find_caller();
-  if (!is_muted(parse_program(caller[TRACE_PROGRAM]), caller[TRACE_LOC])) {
-    msg = funcall(formatter, zone, priority, msg, caller);
-    do_output(msg);
+  // the stack walk is only needed for the format, JSON records and the mute
+  // table
+  mixed *caller = 0;
+  string program = 0;
+  if (needs_caller || json_output || sizeof(muted)) {
+    caller = find_caller();
+    if (caller) {
+      program = parse_program(caller[TRACE_PROGRAM]);
+      if (is_muted(program, caller[TRACE_LOC])) {
+        return;
+      }
+    }
+  }
+  string msg = 0;
+  if (human_output) {
+    msg = apply(#'sprintf, ({ msg_fmt }) + args); //'
+    msg = funcall(formatter, zone, priority, msg, caller, format_dates());
   }
+  mapping record = 0;
+  if (json_output) {
+    // formatted at flush time, by encode_record()
+    record = ([
+      "time" : time(),
+      "zone" : zone,
+      "priority" : priority,
+      "program" : program,
+      "line" : (caller ? caller[TRACE_LOC] : 0),
+      "format" : msg_fmt,
+      "args" : args
+    ]);
+  }
+  do_output(msg, record);
   return;
 }
 
+/**
+ * Get the current time in each of the formatter's date formats. Dates are 
+ * formatted at most once per second.
+ *
+ * @return a mapping of date formats to formatted dates
+ */
+private mapping format_dates() {
+  int now = time();
+  if (sizeof(date_formats) && (now != dates_time)) {
+    dates = ([ ]);
+    foreach (string fmt : date_formats) {
+      dates[fmt] = strftime(fmt, now);
+    }
+    dates_time = now;
+  }
+  return dates;
+}
+
 int logging = 0;
 /**
- * Output the formatted log message to all the configured places.
+ * Add a log message to the output buffer, and schedule a flush. If the 
+ * buffer is full, the overflow policy decides whether the oldest or the 
+ * newest message is dropped, or the buffer is flushed right away.
  * 
- * @param msg the formatted log message
+ * @param msg    the formatted log message, or 0 if no output needs it
+ * @param record the raw log event for JSON output, or 0 if no output 
+ *               needs it
  */
-private void do_output(string msg) {
+private void do_output(string msg, mapping record) {
   if (logging) { return; }
+  if (buffer_count == LOG_BUFFER_SIZE) {
+    switch (overflow) {
+      case OVERFLOW_DROP_NEWEST:
+      dropped++;
+      unreported++;
+      return;
+      case OVERFLOW_FLUSH:
+      flush_output();
+      break;
+      default:
+      buffer_start = (buffer_start + 1) % LOG_BUFFER_SIZE;
+      buffer_count--;
+      dropped++;
+      unreported++;
+      break;
+    }
+  }
+  buffer[(buffer_start + buffer_count++) % LOG_BUFFER_SIZE] = 
+    ({ msg, THISP, record });
+  if (!flush_pending) {
+    call_out(#'flush_output, LOG_FLUSH_DELAY); //'
+    flush_pending = 1;
+  }
+}
+
+/**
+ * Write all buffered log messages to the configured places. Each file is 
+ * written once per flush, and each console is sent the messages which were
+ * logged by its player in a single message.
+ */
+public void flush_output() {
+  flush_pending = 0;
+  if (!buffer_count || logging) {
+    return;
+  }
   logging = 1;
-  debug_message(msg + "\n");
+  seteuid(getuid());
+
+  string *msgs = ({ });
+  mapping *records = ({ });
+  // ([ object player : ({ str msg, ... }) ])
+  mapping by_player = ([ ]);
+  for (int i = 0; i < buffer_count; i++) {
+    mixed *entry = buffer[(buffer_start + i) % LOG_BUFFER_SIZE];
+    if (entry[BUFFER_MESSAGE]) {
+      msgs += ({ entry[BUFFER_MESSAGE] });
+      by_player[entry[BUFFER_PLAYER]] = 
+        (by_player[entry[BUFFER_PLAYER]] || ({ })) 
+        + ({ entry[BUFFER_MESSAGE] });
+    }
+    if (entry[BUFFER_RECORD]) {
+      records += ({ entry[BUFFER_RECORD] });
+    }
+  }
+  if (unreported) {
+    if (human_output) {
+      msgs += ({ sprintf("%d log messages dropped", unreported) });
+    }
+    if (json_output) {
+      records += ({ ([ "time" : time(), "zone" : zone, 
+                       "dropped" : unreported ]) });
+    }
+    unreported = 0;
+  }
+  buffer = allocate(LOG_BUFFER_SIZE);
+  buffer_start = 0;
+  buffer_count = 0;
+
+  string text = (sizeof(msgs) ? implode(msgs, "\n") + "\n" : "");
+  string json_text = 0;
+  if (strlen(text)) {
+    debug_message(text);
+  }
   foreach (mixed *target : output) {
     switch (target[0]) {
 #ifdef EOTL
@@ -435,30 +687,76 @@ private void do_output(string msg) {
       );
       if (err) { continue; }
       foreach (object ob : consoles) {
-        catch (tell_object(ob, msg + "\n"));
+        catch (tell_object(ob, text));
       }
       break;
 #else
       case OUT_CONSOLE:
-      mixed *consoles;
-      string err = catch (
-        consoles = expand_objects(target[1], THISP, "", STALE_CLONES);
-        publish
-      );
-      if (err) { continue; }
-      foreach (mixed *ob : consoles) {
-        catch (stderr_msg(msg + "\n", ([ ]), ob[OB_TARGET]));
+      foreach (object who, string *lines : by_player) {
+        string console_text = implode(lines, "\n") + "\n";
+        foreach (object ob : query_consoles(target[1], who)) {
+          catch (stderr_msg(console_text, ([ ]), ob));
+        }
       }
       break;
 #endif
       case OUT_FILE:
-      write_file(target[1], msg + "\n");
+      write_file(target[1], text);
+      break;
+      case OUT_JSON:
+      if (!sizeof(records)) {
+        break;
+      }
+      json_text ||= implode(map(records, #'encode_record), "\n") + "\n"; //'
+      write_file(target[1], json_text);
       break;
     }
   }
   logging = 0;
 }
 
+/**
+ * Serialize a log event to a line of JSON. The message args are encoded 
+ * as they are at flush time; values which JSON can't represent, such as
+ * objects and closures, are encoded as their printed form.
+ *
+ * @param  record the log event
+ * @return        the JSON line
+ */
+private string encode_record(mapping record) {
+  if (pointerp(record["args"])) {
+    record["args"] = map(record["args"], (: 
+      (objectp($1) || closurep($1) || symbolp($1)) ? sprintf("%O", $1) : $1
+    :));
+  }
+  return json_encode(record);
+}
+
+#ifndef EOTL
+/**
+ * Get the consoles an object spec of a console target resolves to for a 
+ * player. Resolved specs are cached for CONSOLE_CACHE_TIME seconds, or 
+ * until the output is changed.
+ *
+ * @param  spec the object spec of the console target
+ * @param  who  the player the spec is resolved for
+ * @return      the console objects
+ */
+private object *query_consoles(string spec, object who) {
+  mixed *entry = consoles[spec] && consoles[spec][who];
+  if (!entry || ((time() - entry[0]) >= CONSOLE_CACHE_TIME)) {
+    mixed *obs = ({ });
+    catch (obs = expand_objects(spec, who, "", STALE_CLONES); publish);
+    entry = ({ time(), map(obs, (: $1[OB_TARGET] :)) });
+    if (!member(consoles, spec)) {
+      consoles[spec] = ([ ]);
+    }
+    consoles[spec][who] = entry;
+  }
+  return entry[1] - ({ 0 });
+}
+#endif
+
 /**
  * Find the last external call in the call stack and return it.
  * @return the info for the last external stack frame from
@@ -37,8 +37,14 @@ private inherit FormatStringLib;
 private mapping loggers;
 /** ([ obj logger : int ref_count ]) */
 private mapping local_ref_counts;
-/** ([ str format : cl formatter ]) */
+/** ([ str format : ({ cl formatter, mapping specs }) ]) */
 private mapping formatters;
+/** ([ str prop_file : mapping props ]), 0 for missing files */
+private nosave mapping properties;
+/** ([ str dir : ([ str zone : mapping config ]) ]) */
+private nosave mapping configs;
+/** number of configs cached */
+private nosave int config_count;
 /** a Logger instance for the factory to use */
 private object factory_logger;
 /** all Logger instances must share a Logger
@@ -47,11 +53,14 @@ private object logger_logger;
 
 public void setup();
 public varargs object get_logger(mixed zone, object rel, int reconfig);
+public mixed *get_log_handle();
 protected mapping read_config(string zone, string dir);
 protected mapping read_properties(string prop_file);
+public void properties_signal(string file, string func);
 protected string read_prop_value(mapping props, string prop, string path, 
                                  string zone);
 protected mixed *parse_output_prop(string val);
+protected mixed *compile_formatter(string format);
 public object get_null_logger();
 public int release_logger(mixed zone, string euid);
 protected int clean_up_loggers();
@@ -65,6 +74,9 @@ public void setup() {
   loggers = ([ ]);
   formatters = ([ ]);
   local_ref_counts = ([ ]);
+  properties = ([ ]);
+  configs = ([ ]);
+  FileTracker->subscribe(PROP_FILE_REGEX, #'properties_signal); //'
   init_static_loggers();
 }
 
@@ -86,6 +98,8 @@ public void setup() {
  * @return          a logger instance
  */
 public varargs object get_logger(mixed zone, object rel, int reconfig) {
+  // every zone logs through logger_logger for now; nothing below, including
+  // read_config() and its caches, takes effect until this is removed
   return logger_logger;
   // normalize some input
   mixed *pathinfo = get_path_info(zone);
@@ -126,13 +140,7 @@ public varargs object get_logger(mixed zone, object rel, int reconfig) {
     config["level"] = DEFAULT_LEVEL;
   }
 
-  // compile formatter
-  closure formatter = formatters[config["format"]];
-  if (!formatter) {
-    formatter = parse_format(config["format"], LOGGER_MESSAGE,
-                             ({ 'zone, 'priority, 'message, 'caller }));
-    formatters[config["format"]] = formatter;
-  }
+  mixed *formatter = compile_formatter(config["format"]);
 
   // configure our logger
   string factory_euid = geteuid();
@@ -151,12 +159,26 @@ public varargs object get_logger(mixed zone, object rel, int reconfig) {
   }
   logger->set_zone(zone);
   logger->set_output(config["output"]);
-  logger->set_formatter(formatter);
+  logger->set_formatter(formatter[FORMATTER_CLOSURE], 
+                        formatter[FORMATTER_SPECS]);
   logger->set_level(config["level"]);
   seteuid(factory_euid);
   return logger;
 }
 
+/**
+ * Retrieve the handle of the calling object's own logger for use by the 
+ * LOG_* macros. See get_logger() for how the logger is found. The handle 
+ * is only shared with other objects loaded from the same file, so a 
+ * program can't change how any other program logs through it.
+ *
+ * @return          the logger's handle
+ */
+public mixed *get_log_handle() {
+  object ob = previous_object();
+  return get_logger(ob, ob)->query_handle(load_name(ob));
+}
+
 /**
  * Read in logger configuration for the specified zone. Starting in the
  * specified directory, this function will look for the file
@@ -171,12 +193,19 @@ public varargs object get_logger(mixed zone, object rel, int reconfig) {
  * </code>
  * FUTURE better to use a struct than a mapping here
  *
+ * Results are cached per directory and zone until a properties file is
+ * changed.
+ *
  * @param  zone     the zone to match configuration properties against
  * @param  dir      the starting directory from which to search for
  *                  properties files
  * @return          the configuration mapping
  */
 protected mapping read_config(string zone, string dir) {
+  string start = dirname(dir);
+  if (configs[start] && member(configs[start], zone)) {
+    return copy(configs[start][zone]);
+  }
   mapping result = ([ ]);  
   while (dir = dirname(dir)) {
     mapping props = read_properties(dir + "/" PROP_FILE);
@@ -212,6 +241,15 @@ protected mapping read_config(string zone, string dir) {
       if (sizeof(result) == sizeof(ALLOWED_PROPS)) { break; }
     }
   }
+  if (config_count >= CONFIG_CACHE_MAX) {
+    configs = ([ ]);
+    config_count = 0;
+  }
+  if (!configs[start]) {
+    configs[start] = ([ ]);
+  }
+  configs[start][zone] = copy(result);
+  config_count++;
   return result;
 }
 
@@ -220,16 +258,22 @@ protected mapping read_config(string zone, string dir) {
  * Properties are defined in a single line, of the format "name=value". Lines
  * beginning with "#" will be treated as comments.
  *
+ * Parsed files are cached until a properties file is changed.
+ *
  * @param  prop_file the path to the property file
  * @return           a mapping of property names to values, or 0 if the file
  *                   could not be read
  */
 protected mapping read_properties(string prop_file) {
+  if (member(properties, prop_file)) {
+    return properties[prop_file];
+  }
   mapping result = ([ ]);
   int count = 0;
 
   string body = read_file(prop_file);
   if (!body) {
+    properties[prop_file] = 0;
     return 0;
   }
   string *lines = explode(body, "\n");
@@ -249,9 +293,25 @@ protected mapping read_properties(string prop_file) {
     string val = line[(equals+1)..];
     result[prop] = val;
   }
+  properties[prop_file] = result;
   return result;
 }
 
+/**
+ * Called when a properties file is modified or removed. Cached properties
+ * and configuration are discarded, since any change may affect the 
+ * configuration of every directory below the file. Loggers which are 
+ * already configured keep their configuration until they are reconfigured.
+ *
+ * @param  file          the properties file
+ * @param  func          the write operation (see valid_write())
+ */
+public void properties_signal(string file, string func) {
+  properties = ([ ]);
+  configs = ([ ]);
+  config_count = 0;
+}
+
 /**
  * Look for a property in the property mapping by name which matches a
  * specific zone, and return its value.
@@ -290,8 +350,11 @@ protected string read_prop_value(mapping props, string prop, string path,
  *
  * <code>({ ({ int type, string target }), ... })</code>
  *
- * where type is one of 'c' or 'f' and target is an object spec or a file
- * path, for console output or file output, respectively.
+ * where type is one of 'c', 'f' or 'j' and target is an object spec or a
+ * file path, for console output, file output, or JSON lines file output,
+ * respectively. JSON lines output records the raw log event (zone, 
+ * priority, caller, message format and args) instead of the formatted
+ * message.
  *
  * @param  val the value of the output property
  * @return     an array of output targets
@@ -311,6 +374,28 @@ protected mixed *parse_output_prop(string val) {
   return result;
 }
 
+/**
+ * Compile a format string into a formatter closure, or get it from the cache
+ * of previously compiled formats. The format specifiers used by the format
+ * are returned with the closure, so that loggers can skip the work of 
+ * finding the caller or formatting dates when the format doesn't use them.
+ *
+ * @param  format the format string
+ * @return        an array of the formatter closure and the mapping of format
+ *                specifiers it uses; see parse_format()
+ */
+protected mixed *compile_formatter(string format) {
+  mixed *result = formatters[format];
+  if (!result) {
+    mapping specs = ([ ]);
+    closure formatter = parse_format(format, LOGGER_MESSAGE, FORMATTER_ARGS, 
+                                     specs);
+    result = ({ formatter, specs });
+    formatters[format] = result;
+  }
+  return result;
+}
+
 /**
  * Return a new no-op logger.
  * @return the logger instance
@@ -341,11 +426,15 @@ public int release_logger(mixed zone, string euid) {
     object logger = loggers[zone][euid];
     if (logger) {
       m_delete(loggers[zone], euid);
+      // the handles refer back to the logger, so they're cleared before 
+      // the references are counted; holders of a handle fetch a new one
+      logger->release_handles();
       local_ref_counts[logger]--;
       int ref_count = (int) object_info(logger, OINFO_BASIC, OIB_REF);
       int local_ref_count = local_ref_counts[logger];
       if ((ref_count - local_ref_count) <= STANDING_REF_COUNT) {
         m_delete(local_ref_counts, logger);
+        logger->flush_output();
         destruct(logger);
       }
       if (!sizeof(loggers[zone])) {
@@ -398,10 +487,9 @@ protected void init_static_loggers() {
 #else
   logger_logger->set_output(parse_output_prop("c:me"));
 #endif
-  logger_logger->set_formatter(
-    parse_format(DEFAULT_FORMAT, LOGGER_MESSAGE,
-                 ({ 'zone, 'priority, 'message, 'caller }))
-  );
+  mixed *formatter = compile_formatter(DEFAULT_FORMAT);
+  logger_logger->set_formatter(formatter[FORMATTER_CLOSURE], 
+                               formatter[FORMATTER_SPECS]);
   logger_logger->set_zone(get_zone(THISO));
 
   seteuid(FACTORY_LOGGER_UID);
@@ -409,10 +497,8 @@ protected void init_static_loggers() {
   export_uid(factory_logger);
   factory_logger->set_level(LVL_WARN);
   factory_logger->set_output(parse_output_prop("f:/log/logger_factory.log"));
-  factory_logger->set_formatter(
-    parse_format(DEFAULT_FORMAT, LOGGER_MESSAGE,
-                 ({ 'zone, 'priority, 'message, 'caller }))
-  );
+  factory_logger->set_formatter(formatter[FORMATTER_CLOSURE], 
+                                formatter[FORMATTER_SPECS]);
   factory_logger->set_zone(get_zone(THISO));
 
   seteuid(euid);
@@ -0,0 +1,244 @@
+/**
+ * A service for collecting command execution metrics. Eval ticks and wall
+ * clock microseconds are recorded per verb and per controller into rolling
+ * histograms, from which percentiles may be queried. Histogram buckets grow
+ * logarithmically, with METRICS_SUB_BUCKETS buckets per power of two, so
+ * percentiles are accurate to within 25% of the recorded value. Two
+ * generations of histograms are kept, each covering METRICS_WINDOW seconds.
+ * Simple event counters, such as throttled and dropped commands, are kept
+ * alongside the histograms.
+ *
+ * @alias MetricsService
+ */
+#pragma no_clone
+#include <metrics.h>
+
+// ([ str category : ([ str name : mixed *metric ]) ])
+private mapping current, previous;
+private int window_start;
+// ([ str category : ([ str name : int count ]) ])
+private mapping counters;
+
+public void setup();
+private int bucket(int value);
+private int bucket_value(int bucket);
+private void rotate();
+public void record(string category, string name, int ticks, int usec);
+private int percentile(mapping *hists, int count, int pct);
+public mapping query_metrics(string category);
+public void increment(string category, string name);
+public mapping query_counters(string category);
+public void reset_metrics();
+
+/**
+ * Setup the MetricsService.
+ */
+public void setup() {
+  reset_metrics();
+}
+
+/**
+ * Get the histogram bucket for a value. Values below METRICS_SUB_BUCKETS get
+ * a bucket each; above that each power of two is split in
+ * METRICS_SUB_BUCKETS equal parts.
+ *
+ * @param  value         the value to bucket
+ * @return the bucket index
+ */
+private int bucket(int value) {
+  if (value < METRICS_SUB_BUCKETS) {
+    return (value < 0 ? 0 : value);
+  }
+  // find the most significant bit
+  int msb = 0;
+  int v = value;
+  if (v >> 32) { msb += 32; v >>= 32; }
+  if (v >> 16) { msb += 16; v >>= 16; }
+  if (v >> 8)  { msb += 8;  v >>= 8; }
+  if (v >> 4)  { msb += 4;  v >>= 4; }
+  if (v >> 2)  { msb += 2;  v >>= 2; }
+  if (v >> 1)  { msb += 1; }
+  int sub = (value >> (msb - METRICS_SUB_BITS)) & (METRICS_SUB_BUCKETS - 1);
+  return ((msb - METRICS_SUB_BITS + 1) * METRICS_SUB_BUCKETS) + sub;
+}
+
+/**
+ * Get the upper bound of the values counted by a histogram bucket.
+ *
+ * @param  bucket        the bucket index
+ * @return the largest value which falls in the bucket
+ */
+private int bucket_value(int bucket) {
+  if (bucket < METRICS_SUB_BUCKETS) {
+    return bucket;
+  }
+  int shift = (bucket / METRICS_SUB_BUCKETS) - 1;
+  int sub = bucket % METRICS_SUB_BUCKETS;
+  return ((METRICS_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+/**
+ * Start a new histogram generation, if the current one has expired.
+ */
+private void rotate() {
+  int now = time();
+  if (now - window_start >= 2 * METRICS_WINDOW) {
+    previous = ([ ]);
+    current = ([ ]);
+    window_start = now;
+  } else if (now - window_start >= METRICS_WINDOW) {
+    previous = current;
+    current = ([ ]);
+    window_start = now;
+  }
+}
+
+/**
+ * Record the cost of a single command execution.
+ *
+ * @param  category      the metric category, METRIC_VERB or
+ *                       METRIC_CONTROLLER
+ * @param  name          the verb or controller name
+ * @param  ticks         the number of eval ticks spent
+ * @param  usec          the number of microseconds spent
+ */
+public void record(string category, string name, int ticks, int usec) {
+  if (time() - window_start >= METRICS_WINDOW) {
+    rotate();
+  }
+  mapping metrics = current[category];
+  if (!metrics) {
+    metrics = current[category] = ([ ]);
+  }
+  mixed *metric = metrics[name];
+  if (!metric) {
+    metric = metrics[name] = ({ 0, 0, 0, ([ ]), 0, 0, ([ ]) });
+  }
+  metric[METRIC_COUNT]++;
+  metric[METRIC_TICKS_TOTAL] += ticks;
+  if (ticks > metric[METRIC_TICKS_MAX]) {
+    metric[METRIC_TICKS_MAX] = ticks;
+  }
+  metric[METRIC_TICKS_HIST][bucket(ticks)]++;
+  metric[METRIC_USEC_TOTAL] += usec;
+  if (usec > metric[METRIC_USEC_MAX]) {
+    metric[METRIC_USEC_MAX] = usec;
+  }
+  metric[METRIC_USEC_HIST][bucket(usec)]++;
+}
+
+/**
+ * Compute a percentile over one or more histograms.
+ *
+ * @param  hists         the histograms, mappings of bucket to count
+ * @param  count         the total count of all histograms
+ * @param  pct           the percentile to compute, 0-100
+ * @return the upper bound of the bucket containing the percentile
+ */
+private int percentile(mapping *hists, int count, int pct) {
+  mapping merged = ([ ]);
+  foreach (mapping hist : hists) {
+    foreach (int b, int n : hist) {
+      merged[b] += n;
+    }
+  }
+  int rank = ((count * pct) + 99) / 100;
+  int seen = 0;
+  foreach (int b : sort_array(m_indices(merged), #'>)) { //'
+    seen += merged[b];
+    if (seen >= rank) {
+      return bucket_value(b);
+    }
+  }
+  return 0;
+}
+
+/**
+ * Query a summary of the recorded metrics in a category, covering the
+ * current and previous histogram generations.
+ *
+ * @param  category      the metric category, METRIC_VERB or
+ *                       METRIC_CONTROLLER
+ * @return a mapping of verb or controller name to summary array; see
+ *         SUMMARY_* in metrics.h
+ */
+public mapping query_metrics(string category) {
+  rotate();
+  mapping result = ([ ]);
+  mapping cur = current[category] || ([ ]);
+  mapping prev = previous[category] || ([ ]);
+  foreach (string name : m_indices(cur) | m_indices(prev)) {
+    mixed **metrics = filter(({ cur[name], prev[name] }), #'pointerp); //'
+    int count = 0, ticks = 0, ticks_max = 0, usec = 0, usec_max = 0;
+    mapping *ticks_hists = ({ });
+    mapping *usec_hists = ({ });
+    foreach (mixed *metric : metrics) {
+      count += metric[METRIC_COUNT];
+      ticks += metric[METRIC_TICKS_TOTAL];
+      ticks_max = max(ticks_max, metric[METRIC_TICKS_MAX]);
+      ticks_hists += ({ metric[METRIC_TICKS_HIST] });
+      usec += metric[METRIC_USEC_TOTAL];
+      usec_max = max(usec_max, metric[METRIC_USEC_MAX]);
+      usec_hists += ({ metric[METRIC_USEC_HIST] });
+    }
+    if (!count) {
+      continue;
+    }
+    result[name] = ({
+      count,
+      ticks / count,
+      min(percentile(ticks_hists, count, 50), ticks_max),
+      min(percentile(ticks_hists, count, 95), ticks_max),
+      min(percentile(ticks_hists, count, 99), ticks_max),
+      ticks_max,
+      usec / count,
+      min(percentile(usec_hists, count, 50), usec_max),
+      min(percentile(usec_hists, count, 95), usec_max),
+      min(percentile(usec_hists, count, 99), usec_max),
+      usec_max
+    });
+  }
+  return result;
+}
+
+/**
+ * Count an event.
+ *
+ * @param  category      the counter category, such as METRIC_THROTTLED or
+ *                       METRIC_DROPPED
+ * @param  name          the name to count the event under
+ */
+public void increment(string category, string name) {
+  mapping category_counters = counters[category];
+  if (!category_counters) {
+    category_counters = counters[category] = ([ ]);
+  }
+  category_counters[name]++;
+}
+
+/**
+ * Query the event counts in a category, since the metrics were last reset.
+ *
+ * @param  category      the counter category
+ * @return a mapping of name to count
+ */
+public mapping query_counters(string category) {
+  return copy(counters[category] || ([ ]));
+}
+
+/**
+ * Discard all recorded metrics.
+ */
+public void reset_metrics() {
+  current = ([ ]);
+  previous = ([ ]);
+  counters = ([ ]);
+  window_start = time();
+}
+
+/**
+ * Constructor.
+ */
+public void create() {
+  setup();
+}
@@ -15,6 +15,9 @@ private inherit MessageLib;
 private inherit CapabilityLib;
 private inherit JSONLib;
 
+// ([ object target : ({ int depth, string output, string prompt }) ])
+private nosave mapping held = ([ ]);
+
 public void setup();
 public varargs struct Message send_message(object target, string topic, 
                                            string message, mapping context, 
@@ -23,6 +26,9 @@ public varargs struct Message prompt_message(object target, string message,
                                              mapping context, object sender);
 private void message(object target, string topic, struct Message msg);
 public void newline(object target);
+public void hold_messages(object target);
+public void release_messages(object target);
+private void transmit(object target, string message, int is_prompt);
 
 /**
  * Setup the PostalService.
@@ -127,7 +133,7 @@ private void message(object target, string topic, struct Message msg) {
       "context" : msg->context
     ]));
   }
-  efun::tell_object(target, message);
+  transmit(target, message, topic == TOPIC_PROMPT);
 }
 
 /**
@@ -137,7 +143,67 @@ private void message(object target, string topic, struct Message msg) {
  * @param  target        the object to which the message should be delivered
  */
 public void newline(object target) {
-  efun::tell_object(target, "\n");
+  transmit(target, "\n", 0);
+}
+
+/**
+ * Hold back all messages to an object until release_messages() is called. 
+ * Held messages are sent together in a single write, and only the most 
+ * recent prompt is kept, so that it comes last. Holds may be nested, in 
+ * which case messages are sent when the outermost hold is released. Only 
+ * the target itself may hold its messages.
+ * 
+ * @param  target        the object whose messages should be held
+ */
+public void hold_messages(object target) {
+  if (target != previous_object()) {
+    raise_error("not allowed to hold messages\n");
+  }
+  if (member(held, target)) {
+    held[target][HELD_DEPTH]++;
+  } else {
+    held[target] = ({ 1, "", 0 });
+  }
+}
+
+/**
+ * Release a hold placed by hold_messages(). If it was the outermost hold,
+ * the held messages are sent, followed by the held prompt, if any.
+ * 
+ * @param  target        the object whose messages are being held
+ */
+public void release_messages(object target) {
+  if (target != previous_object()) {
+    raise_error("not allowed to release messages\n");
+  }
+  mixed *hold = held[target];
+  if (!hold || --hold[HELD_DEPTH]) {
+    return;
+  }
+  m_delete(held, target);
+  string message = hold[HELD_OUTPUT] + (hold[HELD_PROMPT] || "");
+  if (strlen(message)) {
+    efun::tell_object(target, message);
+  }
+}
+
+/**
+ * Write a message to the client, or add it to the target's held messages.
+ * 
+ * @param  target        the object to which the message should be delivered
+ * @param  message       the rendered message
+ * @param  is_prompt     1 if the message is a prompt, which replaces any 
+ *                       previously held prompt
+ */
+private void transmit(object target, string message, int is_prompt) {
+  mixed *hold = held[target];
+  if (!hold) {
+    efun::tell_object(target, message);
+  } else if (is_prompt) {
+    hold[HELD_PROMPT] = message;
+  } else {
+    hold[HELD_OUTPUT] += message;
+  }
 }
 
 /**
@@ -0,0 +1,355 @@
+/**
+ * A service object for tracking loaded command specs. Each spec file is
+ * indexed once and the resulting command array is shared by every command
+ * giver importing it. Callers must treat the returned commands as read-only.
+ * Indexed commands only carry their id, controller, and verbs; the rest of
+ * each command is built the first time it's dispatched, see query_command().
+ * Loaded command controllers are tracked as well, so that dispatching a
+ * command doesn't need to resolve its controller each time, and so are the
+ * generated parsers of commands which use them, see CommandParserLib. A
+ * generated parser is written again whenever it's missing or out of date
+ * with its spec.
+ *
+ * @alias CommandSpecTracker
+ */
+#pragma no_clone
+#include <sys/files.h>
+#include <command_spec.h>
+
+inherit CommandParserLib;
+
+#define SPEC_MTIME           0
+#define SPEC_COMMANDS        1
+
+#define PARSER_SPECFILE      0
+#define PARSER_OBJECT        1
+
+// ([ str specfile : ({ int mtime, mixed *commands }) ])
+private mapping specs;
+// ([ str specfile : ({ int mtime, mixed *compiled }) ])
+private mapping compiled_specs;
+// ([ str specfile : ([ str importing_specfile, ... ]) ])
+private mapping dependents;
+// the spec file currently being parsed, used to record imports
+private string loading;
+// ([ str controller : obj controller ])
+private mapping controllers;
+// ([ str parser : ({ str specfile, obj parser }) ])
+private mapping parsers;
+
+public void setup();
+public void spec_signal(string file, string func);
+protected int query_spec_time(string specfile);
+protected void invalidate_spec(string specfile);
+protected void release_spec(string specfile);
+mixed *load_command_index(string specfile);
+public mixed *query_command_spec(string specfile);
+mixed *load_compiled_spec(string specfile);
+public mixed *query_command(mixed *command);
+protected void check_validators(mixed *command);
+public void controller_signal(string file, string func);
+public object query_controller(string controller);
+public object query_parser(mixed *command);
+protected object load_parser(string parser);
+
+/**
+ * Setup the CommandSpecTracker.
+ */
+public void setup() {
+  FileTracker->subscribe(COMMAND_SPEC_REGEX, #'spec_signal); //'
+  FileTracker->subscribe(CONTROLLER_REGEX, #'controller_signal); //'
+  specs = ([ ]);
+  compiled_specs = ([ ]);
+  dependents = ([ ]);
+  controllers = ([ ]);
+  parsers = ([ ]);
+}
+
+/**
+ * Called when a command spec file is modified or removed.
+ *
+ * @param  file          path to the command spec file
+ * @param  func          write method (see valid_write())
+ */
+public void spec_signal(string file, string func) {
+  invalidate_spec(file);
+}
+
+/**
+ * Return the modification time of a spec file.
+ *
+ * @param  specfile      the spec filename
+ * @return the mtime of the file, or 0 if it doesn't exist
+ */
+protected int query_spec_time(string specfile) {
+  mixed *dates = get_dir(specfile, GETDIR_DATES);
+  if (!sizeof(dates)) {
+    return 0;
+  }
+  return dates[0];
+}
+
+/**
+ * Drop a spec from the registry, along with every spec which imports it.
+ *
+ * @param  specfile      the spec filename
+ */
+protected void invalidate_spec(string specfile) {
+  m_delete(specs, specfile);
+  m_delete(compiled_specs, specfile);
+  release_spec(specfile);
+  // generated parsers are checked against the spec again when next used
+  foreach (string parser : m_indices(parsers)) {
+    if (parsers[parser][PARSER_SPECFILE] == specfile) {
+      m_delete(parsers, parser);
+    }
+  }
+  mapping importers = dependents[specfile];
+  m_delete(dependents, specfile);
+  if (importers) {
+    foreach (string importer : importers) {
+      invalidate_spec(importer);
+    }
+  }
+}
+
+/**
+ * Override CommandParserLib so that imported specs are resolved through the
+ * registry, and the import dependency is recorded for invalidation.
+ *
+ * @param  specfile      the spec filename
+ * @return the indexed commands
+ */
+mixed *load_command_index(string specfile) {
+  return query_command_spec(specfile);
+}
+
+/**
+ * Get the indexed commands for a spec file, indexing it only if it hasn't
+ * been loaded yet or has changed on disk since it was.
+ *
+ * @param  specfile      the spec filename
+ * @return the indexed commands
+ */
+public mixed *query_command_spec(string specfile) {
+  if (loading) {
+    dependents[specfile] ||= ([ ]);
+    dependents[specfile] += ([ loading ]);
+  }
+
+  int mtime = query_spec_time(specfile);
+  mixed *spec = specs[specfile];
+  if (spec && (spec[SPEC_MTIME] == mtime)) {
+    return spec[SPEC_COMMANDS];
+  }
+
+  string previous = loading;
+  loading = specfile;
+  mixed *commands;
+  string err = catch(commands = CommandParserLib::load_command_index(specfile));
+  loading = previous;
+  if (err) {
+    raise_error(err);
+  }
+
+  specs[specfile] = ({ mtime, commands });
+  return commands;
+}
+
+/**
+ * Override CommandParserLib so that a spec file is only compiled once for
+ * all of its commands, rather than once per command materialized.
+ *
+ * @param  specfile      the spec filename
+ * @return the compiled spec
+ */
+mixed *load_compiled_spec(string specfile) {
+  int mtime = query_spec_time(specfile);
+  mixed *spec = compiled_specs[specfile];
+  if (spec && (spec[SPEC_MTIME] == mtime)) {
+    return spec[SPEC_COMMANDS];
+  }
+  mixed *compiled = CommandParserLib::load_compiled_spec(specfile);
+  if (spec) {
+    // changed on disk without a write signal
+    release_spec(specfile);
+  }
+  compiled_specs[specfile] = ({ mtime, compiled });
+  return compiled;
+}
+
+/**
+ * Tell the loaded controllers to drop what they compiled or bound for a 
+ * spec file's commands.
+ *
+ * @param  specfile      the spec filename
+ */
+protected void release_spec(string specfile) {
+  foreach (string path, object controller : controllers) {
+    if (controller) {
+      controller->release_spec(specfile);
+    }
+  }
+}
+
+/**
+ * Get the full definition of an indexed command, building it if this is
+ * the first time the command has been needed.
+ *
+ * @param  command       the indexed command, as returned by 
+ *                       query_command_spec()
+ * @return the full command, or 0 if it couldn't be built
+ */
+public mixed *query_command(mixed *command) {
+  if (pointerp(command[COMMAND_SYNTAX])) {
+    return command;
+  }
+
+  mixed *result;
+  string err = catch(result = materialize_command(command); publish);
+  if (err) {
+    logger->info("error building command %O from %s: %s", 
+                 command[COMMAND_VERBS], command[COMMAND_SPECFILE], err);
+    return 0;
+  }
+  check_validators(result);
+  return result;
+}
+
+/**
+ * Report the validators used by a newly built command which its controller
+ * doesn't define, so that they're found when the command is first 
+ * dispatched rather than when a validation runs.
+ *
+ * @param  command       the full command
+ */
+protected void check_validators(mixed *command) {
+  string specfile = command[COMMAND_SPECFILE];
+  object controller = query_controller(
+    expand_path(command[COMMAND_CONTROLLER], specfile));
+  if (!controller) {
+    return;
+  }
+  string *unknown = unknown_validators(command, controller);
+  if (sizeof(unknown)) {
+    logger->info("unknown validators for command %O from %s: %s", 
+                 command[COMMAND_VERBS], specfile, implode(unknown, ", "));
+  }
+}
+
+/**
+ * Called when an LPC source file is modified or removed. Drops the cached
+ * handle of any controller or generated parser loaded from that file, and
+ * ignores every other file.
+ *
+ * @param  file          path to the source file
+ * @param  func          write method (see valid_write())
+ */
+public void controller_signal(string file, string func) {
+  string path = (file[0] == '/' ? file[0..<3] : "/" + file[0..<3]);
+  if (member(controllers, path)) {
+    m_delete(controllers, path);
+  }
+  if (member(parsers, path)) {
+    m_delete(parsers, path);
+  }
+}
+
+/**
+ * Get the object for a command controller, loading it if it isn't already
+ * cached. Destructed controllers fall out of the cache on their own.
+ *
+ * @param  controller    the path to the controller
+ * @return the loaded controller object, or 0 if it failed to load
+ */
+public object query_controller(string controller) {
+  if (controller[<2..] == ".c") {
+    controller = controller[0..<3];
+  }
+  object result = controllers[controller];
+  if (result) {
+    return result;
+  }
+
+  string err = catch(result = load_object(controller); publish);
+  if (err) {
+    logger->info("error loading controller %s: %s", controller, err);
+    return 0;
+  }
+  controllers[controller] = result;
+  return result;
+}
+
+/**
+ * Get the generated parser program of a command, loading it if it isn't
+ * already cached. A parser is only used if it was generated from the 
+ * current version of the spec which defines the command, so a missing or
+ * out of date parser is generated again from the spec first. If that 
+ * fails, the command falls back to CommandLib's apply_syntax().
+ *
+ * @param  command       the full command
+ * @return the parser object, or 0 if the command has no usable parser
+ */
+public object query_parser(mixed *command) {
+  string parser = command[COMMAND_PARSER];
+  if (!parser) {
+    return 0;
+  }
+  // out of date parsers are cached as 0 until the parser or spec changes
+  mixed *cached = parsers[parser];
+  if (cached) {
+    return cached[PARSER_OBJECT];
+  }
+
+  string specfile = command[COMMAND_SPECFILE];
+  string digest;
+  string err = catch(
+    digest = load_compiled_spec(specfile)[COMPILED_HASH]; 
+    publish);
+  if (err) {
+    logger->info("error loading parser %s: %s", parser, err);
+    return 0;
+  }
+
+  object result = load_parser(parser);
+  if (!result || (result->query_spec_hash() != digest)) {
+    err = catch(generate_command_parsers(specfile); publish);
+    if (err) {
+      logger->info("error generating parsers from %s: %s", specfile, err);
+    }
+    result = load_parser(parser);
+  }
+  if (result && (result->query_spec_hash() != digest)) {
+    logger->info("parser %s is out of date with %s", parser, specfile);
+    result = 0;
+  }
+  parsers[parser] = ({ specfile, result });
+  return result;
+}
+
+/**
+ * Load a generated parser program.
+ *
+ * @param  parser        the path to the parser program
+ * @return the parser object, or 0 if it hasn't been generated or failed
+ *         to load
+ */
+protected object load_parser(string parser) {
+  if (!file_exists(parser + ".c")) {
+    return 0;
+  }
+  object result;
+  string err = catch(result = load_object(parser); publish);
+  if (err) {
+    logger->info("error loading parser %s: %s", parser, err);
+    return 0;
+  }
+  return result;
+}
+
+/**
+ * Constructor.
+ */
+public void create() {
+  setup();
+}
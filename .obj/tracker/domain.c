@@ -7,6 +7,8 @@
 #pragma no_clone
 #include <sys/xml.h>
 #include <domain.h>
+#include <rate_limit.h>
+#include <command.h>
 
 private inherit FileLib;
 private inherit DomainLib;
@@ -17,6 +19,8 @@ private mapping domains;
 private mapping children;
 // ([ str domain_root : DomainConfig domain ])
 private mapping domain_roots;
+// bumped whenever a domain is added, changed or removed
+private int config_version;
 
 public void setup();
 public void reconfig_signal(string file, string func);
@@ -25,12 +29,17 @@ protected void parse_directive(mixed *tag, struct DomainConfig config,
                                mixed *read_checker, mixed *write_checker);
 protected void parse_configure_access(mixed *tag, mixed *read_checker,
                                       mixed *write_checker);
+protected void parse_rate_limit(mixed *tag, struct DomainConfig config);
+protected void parse_command_budget(mixed *tag, struct DomainConfig config);
 protected string get_parent_domain_file(string domain_file);
 protected string get_domain_root(string domain_file);
 protected int update_domain(struct DomainConfig config);
 protected int delete_domain(struct DomainConfig config);
 string query_domain_id(string path);
 mapping query_children(string domain_id);
+public mixed *query_rate_limit(string domain_id, string user_class);
+public int *query_command_budget(string domain_id);
+public int query_config_version();
 public string resolve_sysinclude(string file, string p);
 
 /**
@@ -82,7 +91,7 @@ public void reconfig_signal(string file, string func) {
  */
 protected struct DomainConfig parse_config(string domain_file) {
   object logger = LoggerFactory->get_logger(THISO);
-  struct DomainConfig config = (<DomainConfig>);
+  struct DomainConfig config = (<DomainConfig> rate_limits: ([ ]));
 
   // root dir for
   config->root = get_domain_root(domain_file);
@@ -166,6 +175,10 @@ protected void parse_directive(mixed *tag, struct DomainConfig config,
                                mixed *read_checker, mixed *write_checker) {
   if (tag[XML_TAG_NAME] == "configureAccess") {
     parse_configure_access(tag, &read_checker, &write_checker);
+  } else if (tag[XML_TAG_NAME] == "rateLimit") {
+    parse_rate_limit(tag, config);
+  } else if (tag[XML_TAG_NAME] == "commandBudget") {
+    parse_command_budget(tag, config);
   }
   return;
 }
@@ -317,6 +330,71 @@ protected void parse_configure_access(mixed *tag, mixed *read_checker,
   return;
 }
 
+/**
+ * Parse the "rateLimit" configuration directive, which limits the rate at
+ * which connections in the domain may issue commands. The class attribute
+ * selects the user class the limit applies to, and may be omitted to
+ * apply it to every class without a limit of its own. Unspecified settings
+ * use the defaults from rate_limit.h.
+ *
+ * @param tag           the rateLimit tag
+ * @param config        the domain config being built
+ */
+protected void parse_rate_limit(mixed *tag, struct DomainConfig config) {
+  object logger = LoggerFactory->get_logger(THISO);
+  mapping attributes = tag[XML_TAG_ATTRIBUTES] || ([ ]);
+  mixed *limit = ({ DEFAULT_RATE_LIMIT_RATE, DEFAULT_RATE_LIMIT_BURST,
+                    DEFAULT_RATE_LIMIT_QUEUE });
+  if (member(attributes, "rate")) {
+    limit[RATE_LIMIT_RATE] = to_float(attributes["rate"]);
+  }
+  if (member(attributes, "burst")) {
+    limit[RATE_LIMIT_BURST] = to_int(attributes["burst"]);
+  }
+  if (member(attributes, "queue")) {
+    limit[RATE_LIMIT_QUEUE] = to_int(attributes["queue"]);
+  }
+  if ((limit[RATE_LIMIT_RATE] <= 0) || (limit[RATE_LIMIT_BURST] < 1)
+      || (limit[RATE_LIMIT_QUEUE] < 0)) {
+    logger->info("invalid domain.xml: bad rateLimit settings: %O", 
+                 attributes);
+    return;
+  }
+  config->rate_limits[attributes["class"] || USER_CLASS_ANY] = limit;
+  return;
+}
+
+/**
+ * Parse the "commandBudget" configuration directive, which sets the 
+ * default eval and memory budgets for executing the commands of the 
+ * domain's controllers. Commands may override it with budget attributes in
+ * their command spec. Budgets which aren't given are unlimited, beyond the
+ * driver's own limits.
+ *
+ * @param tag           the commandBudget tag
+ * @param config        the domain config being built
+ */
+protected void parse_command_budget(mixed *tag, struct DomainConfig config) {
+  object logger = LoggerFactory->get_logger(THISO);
+  mapping attributes = tag[XML_TAG_ATTRIBUTES] || ([ ]);
+  int *budget = allocate(BUDGET_SIZE);
+  foreach (string attribute, int index : ([ "eval" : BUDGET_EVAL, 
+                                            "array" : BUDGET_ARRAY,
+                                            "mapping" : BUDGET_MAPPING,
+                                            "byte" : BUDGET_BYTE ])) {
+    if (member(attributes, attribute)) {
+      budget[index] = to_int(attributes[attribute]);
+      if (budget[index] <= 0) {
+        logger->info("invalid domain.xml: bad commandBudget %s: %O", 
+                     attribute, attributes[attribute]);
+        return;
+      }
+    }
+  }
+  config->command_budget = budget;
+  return;
+}
+
 /**
  * For a specified domain file, return the parent domain file, or 0 if no
  * parent domain exists.
@@ -382,6 +460,7 @@ protected int update_domain(struct DomainConfig config) {
   }
   domains[config->domain_id] = config;
   domain_roots[config->root] = config;
+  config_version++;
   return 1;
 }
 
@@ -434,6 +513,7 @@ protected int delete_domain(struct DomainConfig config) {
     }
   }
 
+  config_version++;
   return 1;
 }
 
@@ -494,6 +574,59 @@ mapping query_children(string domain_id) {
   return copy(children[domain_id]);
 }
 
+/**
+ * Get the command rate limit for a user class in a domain. A domain without
+ * a limit for the class, or for every class, inherits the limit of its
+ * parent domain.
+ *
+ * @param  domain_id  the domain id
+ * @param  user_class the user class, see USER_CLASS_* in rate_limit.h
+ * @return            the rate limit; see RATE_LIMIT_* in rate_limit.h, or 0
+ *                    if no domain configures one
+ */
+public mixed *query_rate_limit(string domain_id, string user_class) {
+  struct DomainConfig config = domains[domain_id];
+  while (config) {
+    mixed *limit = config->rate_limits[user_class] 
+                   || config->rate_limits[USER_CLASS_ANY];
+    if (limit) {
+      return copy(limit);
+    }
+    config = domains[config->parent];
+  }
+  return 0;
+}
+
+/**
+ * Get the default command budget of a domain. A domain without a budget of
+ * its own inherits the budget of its parent domain.
+ *
+ * @param  domain_id  the domain id
+ * @return            the budget; see BUDGET_* in command.h, or 0 if no 
+ *                    domain configures one
+ */
+public int *query_command_budget(string domain_id) {
+  struct DomainConfig config = domains[domain_id];
+  while (config) {
+    if (config->command_budget) {
+      return copy(config->command_budget);
+    }
+    config = domains[config->parent];
+  }
+  return 0;
+}
+
+/**
+ * Get the version of the domain configuration, which changes whenever a
+ * domain is added, changed or removed. Callers caching anything derived
+ * from domain configs can compare it to tell when to look them up again.
+ *
+ * @return            the config version
+ */
+public int query_config_version() {
+  return config_version;
+}
+
 /**
  * Resolve a sysinclude (<file> style include) for files in a domain. First
  * the domain's .include/ directory will be tried, if no matching file was
@@ -41,6 +41,7 @@ public object reload_tracker(string tracker) {
  */
 public void load_trackers() {
   reload_tracker(FileTracker);
+  reload_tracker(CommandSpecTracker);
   reload_tracker(DomainTracker);
   reload_tracker(ProgramTracker);
   reload_tracker(ObjectTracker);